@@ -1,5 +1,8 @@
 #pragma once
 #include <glad/glad.h>
+#include <cstddef>
+
+#include "renderstate.h"
 
 class VertexArray 
 {
@@ -8,14 +11,25 @@ public:
 	VertexArray()
 	{
 		glGenVertexArrays(1, &ID);
-		glBindVertexArray(ID);
+		renderState().bindVertexArray(ID);
 	}
 	void bind()
 	{
-		glBindVertexArray(ID);
+		renderState().bindVertexArray(ID);
 	}
 	void unbind()
 	{
-		glBindVertexArray(0);
+		renderState().bindVertexArray(0);
+	}
+	// a matrix attribute occupies one location per column, i.e. a mat4 at location 3 fills 3 to 6.
+	// divisor 1 advances it once per instance instead of once per vertex
+	void setInstancedMatrixAttribute(unsigned int location, int columns, int rows, int stride, size_t offset)
+	{
+		for (int i = 0; i < columns; i++)
+		{
+			glVertexAttribPointer(location + i, rows, GL_FLOAT, GL_FALSE, stride, (void*)(offset + i * rows * sizeof(float)));
+			glEnableVertexAttribArray(location + i);
+			glVertexAttribDivisor(location + i, 1);
+		}
 	}
 };
\ No newline at end of file
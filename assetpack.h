@@ -0,0 +1,216 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+
+#ifdef _WIN32
+// glad already defined APIENTRY the same way windows.h is about to, drop it so the redefinition doesn't warn
+#ifdef APIENTRY
+#undef APIENTRY
+#endif
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// .pack layout: a 16 byte header, entryCount table of contents entries, then every file's bytes starting on a
+// PACK_ALIGNMENT boundary. all integers little endian
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 64
+#define PACK_NAME_LENGTH 112
+
+struct PackHeader
+{
+	char magic[4]; // "APAK"
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+};
+
+struct PackEntry
+{
+	char name[PACK_NAME_LENGTH]; // the path the file was packed under, zero terminated
+	uint64_t offset;
+	uint64_t size;
+};
+static_assert(sizeof(PackHeader) == 16 && sizeof(PackEntry) == 128, "pack structs must match the file layout");
+
+// One read only memory mapping of a whole .pack file. Lookups hand out pointers straight into the mapping, so
+// nothing is read from disk until those pages are first touched.
+class AssetPack
+{
+public:
+	~AssetPack() { close(); }
+
+	bool open(const char* path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx(file, &fileSize);
+		size = (size_t)fileSize.QuadPart;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		base = mapping ? (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) return false;
+		struct stat info;
+		fstat(fd, &info);
+		size = (size_t)info.st_size;
+		void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		base = mapped == MAP_FAILED ? NULL : (const unsigned char*)mapped;
+#endif
+		if (!base)
+		{
+			std::cout << "ERROR::ASSETPACK::MAP_FAILED: " << path << std::endl;
+			close();
+			return false;
+		}
+
+		const PackHeader* header = (const PackHeader*)base;
+		if (size < sizeof(PackHeader) || memcmp(header->magic, "APAK", 4) != 0 || header->version != PACK_VERSION
+			|| size < sizeof(PackHeader) + (size_t)header->entryCount * sizeof(PackEntry))
+		{
+			std::cout << "ERROR::ASSETPACK::BAD_HEADER: " << path << std::endl;
+			close();
+			return false;
+		}
+		const PackEntry* entries = (const PackEntry*)(base + sizeof(PackHeader));
+		for (uint32_t i = 0; i < header->entryCount; i++)
+			if (entries[i].offset + entries[i].size <= size) index[std::string(entries[i].name)] = &entries[i];
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (base) UnmapViewOfFile(base);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (base) munmap((void*)base, size);
+#endif
+		base = NULL;
+		size = 0;
+		index.clear();
+	}
+
+	bool isOpen() const { return base != NULL; }
+	size_t entryCount() const { return index.size(); }
+
+	// NULL when the pack doesn't have the file
+	const unsigned char* find(const std::string& name, size_t& fileSize) const
+	{
+		auto it = index.find(name);
+		if (it == index.end()) return NULL;
+		fileSize = (size_t)it->second->size;
+		return base + it->second->offset;
+	}
+
+private:
+	const unsigned char* base = NULL;
+	size_t size = 0;
+	std::unordered_map<std::string, const PackEntry*> index;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+};
+
+// the pack everything loads from once it's open, opened at startup in main
+inline AssetPack& assetPack()
+{
+	static AssetPack pack;
+	return pack;
+}
+
+// The contents of one asset: a view into the mapped pack when it's in there, otherwise the loose file read into
+// memory the old way
+class AssetFile
+{
+public:
+	AssetFile(const std::string& name)
+	{
+		view = assetPack().find(name, viewSize);
+		if (view) return;
+
+		std::ifstream file(name, std::ios::binary | std::ios::ate);
+		if (!file) return;
+		owned.resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read(owned.data(), owned.size());
+	}
+
+	bool valid() const { return view != NULL || !owned.empty(); }
+	bool mapped() const { return view != NULL; }
+	const unsigned char* data() const { return view ? view : (const unsigned char*)owned.data(); }
+	size_t size() const { return view ? viewSize : owned.size(); }
+
+private:
+	const unsigned char* view = NULL;
+	size_t viewSize = 0;
+	std::vector<char> owned;
+};
+
+// the packer: every file under the name it was given on the command line, in that order
+inline bool writeAssetPack(const char* output, const std::vector<std::string>& files)
+{
+	std::vector<PackEntry> entries(files.size());
+	std::vector<std::vector<char>> contents(files.size());
+	uint64_t offset = sizeof(PackHeader) + files.size() * sizeof(PackEntry);
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		if (files[i].size() >= PACK_NAME_LENGTH)
+		{
+			std::cout << "ERROR::ASSETPACK::NAME_TOO_LONG: " << files[i] << std::endl;
+			return false;
+		}
+		std::ifstream file(files[i], std::ios::binary | std::ios::ate);
+		if (!file)
+		{
+			std::cout << "ERROR::ASSETPACK::FILE_NOT_READ: " << files[i] << std::endl;
+			return false;
+		}
+		contents[i].resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read(contents[i].data(), contents[i].size());
+
+		memset(&entries[i], 0, sizeof(PackEntry));
+		strcpy(entries[i].name, files[i].c_str());
+		offset = (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+		entries[i].offset = offset;
+		entries[i].size = contents[i].size();
+		offset += contents[i].size();
+	}
+
+	std::ofstream out(output, std::ios::binary);
+	PackHeader header = { { 'A', 'P', 'A', 'K' }, PACK_VERSION, (uint32_t)files.size(), 0 };
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)entries.data(), entries.size() * sizeof(PackEntry));
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		static const char padding[PACK_ALIGNMENT] = {};
+		out.write(padding, entries[i].offset - (uint64_t)out.tellp());
+		out.write(contents[i].data(), contents[i].size());
+	}
+	if (!out)
+	{
+		std::cout << "ERROR::ASSETPACK::FILE_NOT_WRITTEN: " << output << std::endl;
+		return false;
+	}
+	return true;
+}
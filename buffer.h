@@ -1,24 +1,42 @@
 #pragma once
 #include <glad/glad.h>
+#include <iostream>
+
+#include "renderstate.h"
+
 class VertexBuffer
 {
 public:
     unsigned int ID;
-    VertexBuffer(const void* data, unsigned int size)
+    unsigned int capacity;
+    unsigned int usage;
+    VertexBuffer(const void* data, unsigned int size, unsigned int usage = GL_STATIC_DRAW)
     {
+        this->capacity = size;
+        this->usage = usage;
         glGenBuffers(1, &ID);
-        glBindBuffer(GL_ARRAY_BUFFER, ID);
-        glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+        renderState().bindBuffer(GL_ARRAY_BUFFER, ID);
+        glBufferData(GL_ARRAY_BUFFER, size, data, usage);
+    }
+
+    // re-specifies the contents, growing the store when needed. an equally sized update orphans the old
+    // store first so the driver can hand back fresh memory instead of waiting on draws still reading it
+    void update(const void* data, unsigned int size)
+    {
+        renderState().bindBuffer(GL_ARRAY_BUFFER, ID);
+        if (size > capacity) capacity = size;
+        glBufferData(GL_ARRAY_BUFFER, capacity, NULL, usage);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
     }
 
     void bind()
     {
-        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        renderState().bindBuffer(GL_ARRAY_BUFFER, ID);
     }
 
     void unbind()
     {
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        renderState().bindBuffer(GL_ARRAY_BUFFER, 0);
     }
 };
 
@@ -42,4 +60,180 @@ public:
     {
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
-};
\ No newline at end of file
+};
+
+// a std140 uniform block's backing store, attached to a fixed binding point that every program
+// declaring the block with the same layout(binding = N) reads from, so it's written once per frame
+class UniformBuffer
+{
+public:
+    unsigned int ID;
+    unsigned int size;
+    unsigned int bindingPoint;
+    UniformBuffer(unsigned int size, unsigned int bindingPoint)
+    {
+        this->size = size;
+        this->bindingPoint = bindingPoint;
+        glGenBuffers(1, &ID);
+        renderState().bindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+        renderState().bindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, ID);
+    }
+
+    void update(const void* data, unsigned int size, unsigned int offset = 0)
+    {
+        renderState().bindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+    }
+
+    void bind()
+    {
+        renderState().bindBuffer(GL_UNIFORM_BUFFER, ID);
+    }
+
+    void unbind()
+    {
+        renderState().bindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+};
+
+// a std430 shader storage block's backing store on a fixed binding point. unlike a uniform block it can be
+// sized at runtime (unsized arrays in GLSL), so the store grows whenever an update doesn't fit
+class ShaderStorageBuffer
+{
+public:
+    unsigned int ID;
+    unsigned int capacity;
+    unsigned int bindingPoint;
+    ShaderStorageBuffer(unsigned int capacity, unsigned int bindingPoint)
+    {
+        this->capacity = capacity > 0 ? capacity : 16;
+        this->bindingPoint = bindingPoint;
+        glGenBuffers(1, &ID);
+        renderState().bindBuffer(GL_SHADER_STORAGE_BUFFER, ID);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, this->capacity, NULL, GL_DYNAMIC_DRAW);
+        renderState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, bindingPoint, ID);
+    }
+
+    void update(const void* data, unsigned int size)
+    {
+        reserve(size);
+        if (size > 0) glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+    }
+
+    // grows the store without writing it, for buffers only shaders fill. leaves the buffer bound
+    void reserve(unsigned int size)
+    {
+        renderState().bindBuffer(GL_SHADER_STORAGE_BUFFER, ID);
+        if (size > capacity)
+        {
+            while (capacity < size) capacity *= 2;
+            glBufferData(GL_SHADER_STORAGE_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+        }
+    }
+
+    void bind()
+    {
+        renderState().bindBuffer(GL_SHADER_STORAGE_BUFFER, ID);
+    }
+
+    void unbind()
+    {
+        renderState().bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+};
+
+#define PERSISTENT_BUFFER_FRAMES 3
+
+// A store that stays mapped for its whole life (glBufferStorage with GL_MAP_PERSISTENT_BIT), written straight
+// through the pointer with no glBufferSubData copy. It's split into PERSISTENT_BUFFER_FRAMES regions used round
+// robin, and a region is only handed out again once the fence placed after the draws reading it has signalled, so
+// the CPU never overwrites what the GPU hasn't read yet. Coherent, so nothing has to be flushed before drawing.
+// Mapped for reading instead it's a readback ring: copy into the region begin() hands out, and what's there when
+// it comes round again is from PERSISTENT_BUFFER_FRAMES frames ago and already complete
+class PersistentBuffer
+{
+public:
+    unsigned int ID = 0;
+    GLenum target;
+    unsigned int regionSize = 0;
+    unsigned int region = 0; // the one begin() handed out last
+    unsigned int alignment; // of every region's offset, i.e. GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT for an SSBO
+    unsigned int waits = 0; // times begin() found its region still in use and had to block
+    GLbitfield access; // GL_MAP_WRITE_BIT or GL_MAP_READ_BIT
+    PersistentBuffer(GLenum target, unsigned int alignment = 4, GLbitfield access = GL_MAP_WRITE_BIT)
+        : target(target), alignment(alignment), access(access)
+    {
+    }
+
+    // the next region, with room for at least size bytes. a bigger size reallocates the whole store
+    unsigned char* begin(unsigned int size)
+    {
+        if (size > regionSize) allocate(size);
+        region = (region + 1) % PERSISTENT_BUFFER_FRAMES;
+        GLsync& fence = fences[region];
+        if (fence)
+        {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                waits++;
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+            }
+            glDeleteSync(fence);
+            fence = 0;
+        }
+        return mapped + offset();
+    }
+
+    // after the last command reading the region begin() handed out
+    void end()
+    {
+        if (!fences[region]) fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    unsigned int offset() const
+    {
+        return region * regionSize;
+    }
+
+    void destroy()
+    {
+        release();
+    }
+
+private:
+    unsigned char* mapped = NULL;
+    GLsync fences[PERSISTENT_BUFFER_FRAMES] = {};
+
+    void allocate(unsigned int size)
+    {
+        // deleting a buffer the GPU is still reading is fine, GL keeps the store alive until it's done
+        release();
+        regionSize = regionSize > 0 ? regionSize : 256;
+        while (regionSize < size) regionSize *= 2;
+        regionSize = (regionSize + alignment - 1) / alignment * alignment;
+        GLbitfield flags = access | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &ID);
+        renderState().bindBuffer(target, ID);
+        glBufferStorage(target, (GLsizeiptr)regionSize * PERSISTENT_BUFFER_FRAMES, NULL, flags);
+        mapped = (unsigned char*)glMapBufferRange(target, 0, (GLsizeiptr)regionSize * PERSISTENT_BUFFER_FRAMES, flags);
+        if (!mapped) std::cout << "ERROR::BUFFER::PERSISTENT_MAP_FAILED: " << regionSize * PERSISTENT_BUFFER_FRAMES << " bytes" << std::endl;
+    }
+
+    void release()
+    {
+        for (GLsync& fence : fences)
+        {
+            if (fence) glDeleteSync(fence);
+            fence = 0;
+        }
+        if (ID)
+        {
+            renderState().bindBuffer(target, ID);
+            glUnmapBuffer(target);
+            renderState().deleteBuffers(1, &ID);
+        }
+        ID = 0;
+        mapped = NULL;
+    }
+};
@@ -0,0 +1,351 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+
+// 32 bytes so two siblings share a cache line. a node with count > 0 is a leaf holding objectIndices
+// [leftOrFirst, leftOrFirst + count), otherwise its children are nodes leftOrFirst and leftOrFirst + 1
+struct BVHNode
+{
+	glm::vec3 boundsMin;
+	unsigned int leftOrFirst;
+	glm::vec3 boundsMax;
+	unsigned int count;
+};
+
+// Bounding volume hierarchy over a BoundsList, built top down with a binned surface area heuristic and stored
+// as one flat node array. Children always come after their parent, which is what lets refit() run as a single
+// backwards sweep instead of a recursive walk.
+class BVH
+{
+public:
+	std::vector<BVHNode> nodes;
+	std::vector<unsigned int> objectIndices;
+
+	void build(const BoundsList& bounds)
+	{
+		size_t count = bounds.size();
+		nodes.clear();
+		objectIndices.resize(count);
+		for (size_t i = 0; i < count; i++) objectIndices[i] = (unsigned int)i;
+		if (count == 0) return;
+
+		centroids.resize(count);
+		for (size_t i = 0; i < count; i++)
+			centroids[i] = glm::vec3(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+
+		nodes.reserve(2 * count);
+		nodes.push_back(BVHNode());
+		nodes[0].leftOrFirst = 0;
+		nodes[0].count = (unsigned int)count;
+		std::vector<unsigned int> stack(1, 0), depths(1, 0);
+		while (!stack.empty())
+		{
+			unsigned int nodeIndex = stack.back();
+			stack.pop_back();
+			unsigned int depth = depths.back();
+			depths.pop_back();
+			updateNodeBounds(nodes[nodeIndex], bounds);
+
+			// the depth cap keeps the fixed size traversal stacks below safe, it only kicks in for degenerate input
+			unsigned int leftCount;
+			if (depth >= MAX_DEPTH || !split(nodeIndex, bounds, leftCount)) continue;
+
+			unsigned int first = nodes[nodeIndex].leftOrFirst, total = nodes[nodeIndex].count;
+			unsigned int left = (unsigned int)nodes.size();
+			nodes.push_back(BVHNode());
+			nodes.push_back(BVHNode());
+			nodes[left].leftOrFirst = first;
+			nodes[left].count = leftCount;
+			nodes[left + 1].leftOrFirst = first + leftCount;
+			nodes[left + 1].count = total - leftCount;
+			nodes[nodeIndex].leftOrFirst = left;
+			nodes[nodeIndex].count = 0;
+			stack.push_back(left + 1);
+			stack.push_back(left);
+			depths.push_back(depth + 1);
+			depths.push_back(depth + 1);
+		}
+	}
+
+	// keeps the tree shape and only recomputes the boxes, much cheaper than build() for objects that move a
+	// little each frame. the tree quality slowly degrades as objects drift, rebuild now and then when it does.
+	// the bounds must describe the same objects as at build time
+	void refit(const BoundsList& bounds)
+	{
+		for (size_t i = nodes.size(); i-- > 0;)
+		{
+			BVHNode& node = nodes[i];
+			if (node.count > 0)
+			{
+				updateNodeBounds(node, bounds);
+				continue;
+			}
+			const BVHNode& left = nodes[node.leftOrFirst];
+			const BVHNode& right = nodes[node.leftOrFirst + 1];
+			node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+			node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+		}
+	}
+
+	// appends every object whose box intersects the frustum. whole subtrees that are fully inside are taken
+	// without testing anything below them
+	void cullFrustum(const Frustum& frustum, const BoundsList& bounds, std::vector<unsigned int>& visible) const
+	{
+		if (nodes.empty()) return;
+		unsigned int stack[MAX_DEPTH + 2];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const BVHNode& node = nodes[stack[--top]];
+			int side = frustum.classifyAABB((node.boundsMin + node.boundsMax) * 0.5f, (node.boundsMax - node.boundsMin) * 0.5f);
+			if (side < 0) continue;
+			if (side > 0)
+			{
+				appendSubtree(node, visible);
+				continue;
+			}
+			if (node.count > 0)
+			{
+				for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+				{
+					unsigned int object = objectIndices[i];
+					glm::vec3 center(bounds.centerX[object], bounds.centerY[object], bounds.centerZ[object]);
+					glm::vec3 extent(bounds.extentX[object], bounds.extentY[object], bounds.extentZ[object]);
+					if (frustum.intersectsAABB(center, extent)) visible.push_back(object);
+				}
+				continue;
+			}
+			stack[top++] = node.leftOrFirst;
+			stack[top++] = node.leftOrFirst + 1;
+		}
+	}
+
+	// nearest object whose box the ray hits, -1 if none. distance is in units of direction's length
+	int raycast(const glm::vec3& origin, const glm::vec3& direction, const BoundsList& bounds, float& distance) const
+	{
+		distance = FLT_MAX;
+		int hit = -1;
+		if (nodes.empty()) return hit;
+		glm::vec3 inverseDirection = 1.0f / direction;
+		unsigned int stack[MAX_DEPTH + 2];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const BVHNode& node = nodes[stack[--top]];
+			if (rayBox(origin, inverseDirection, node.boundsMin, node.boundsMax) >= distance) continue;
+			if (node.count > 0)
+			{
+				for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+				{
+					unsigned int object = objectIndices[i];
+					glm::vec3 center(bounds.centerX[object], bounds.centerY[object], bounds.centerZ[object]);
+					glm::vec3 extent(bounds.extentX[object], bounds.extentY[object], bounds.extentZ[object]);
+					float t = rayBox(origin, inverseDirection, center - extent, center + extent);
+					if (t < distance)
+					{
+						distance = t;
+						hit = (int)object;
+					}
+				}
+				continue;
+			}
+			// visit the nearer child first so the far one is more likely to be skipped
+			unsigned int nearChild = node.leftOrFirst, farChild = node.leftOrFirst + 1;
+			float nearDistance = rayBox(origin, inverseDirection, nodes[nearChild].boundsMin, nodes[nearChild].boundsMax);
+			float farDistance = rayBox(origin, inverseDirection, nodes[farChild].boundsMin, nodes[farChild].boundsMax);
+			if (nearDistance > farDistance) std::swap(nearChild, farChild);
+			stack[top++] = farChild;
+			stack[top++] = nearChild;
+		}
+		return hit;
+	}
+
+	// appends every object whose box overlaps the sphere, e.g. the objects a point light can reach
+	void querySphere(const glm::vec3& center, float radius, const BoundsList& bounds, std::vector<unsigned int>& result) const
+	{
+		if (nodes.empty()) return;
+		unsigned int stack[MAX_DEPTH + 2];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const BVHNode& node = nodes[stack[--top]];
+			if (!sphereBox(center, radius, node.boundsMin, node.boundsMax)) continue;
+			if (node.count > 0)
+			{
+				for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+				{
+					unsigned int object = objectIndices[i];
+					glm::vec3 objectCenter(bounds.centerX[object], bounds.centerY[object], bounds.centerZ[object]);
+					glm::vec3 extent(bounds.extentX[object], bounds.extentY[object], bounds.extentZ[object]);
+					if (sphereBox(center, radius, objectCenter - extent, objectCenter + extent)) result.push_back(object);
+				}
+				continue;
+			}
+			stack[top++] = node.leftOrFirst;
+			stack[top++] = node.leftOrFirst + 1;
+		}
+	}
+
+private:
+	static const int BIN_COUNT = 12;
+	static const unsigned int MAX_LEAF_SIZE = 4;
+	static const unsigned int MAX_DEPTH = 64;
+	std::vector<glm::vec3> centroids;
+
+	void updateNodeBounds(BVHNode& node, const BoundsList& bounds) const
+	{
+		node.boundsMin = glm::vec3(FLT_MAX);
+		node.boundsMax = glm::vec3(-FLT_MAX);
+		for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+		{
+			unsigned int object = objectIndices[i];
+			glm::vec3 center(bounds.centerX[object], bounds.centerY[object], bounds.centerZ[object]);
+			glm::vec3 extent(bounds.extentX[object], bounds.extentY[object], bounds.extentZ[object]);
+			node.boundsMin = glm::min(node.boundsMin, center - extent);
+			node.boundsMax = glm::max(node.boundsMax, center + extent);
+		}
+	}
+
+	static float halfArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		glm::vec3 size = boundsMax - boundsMin;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	// picks the cheapest of BIN_COUNT - 1 candidate planes per axis (binned by centroid) under the SAH and
+	// partitions the node's objects around it. returns false when keeping the node as a leaf is cheaper
+	bool split(unsigned int nodeIndex, const BoundsList& bounds, unsigned int& leftCount)
+	{
+		const BVHNode& node = nodes[nodeIndex];
+		if (node.count <= MAX_LEAF_SIZE) return false;
+		unsigned int first = node.leftOrFirst, count = node.count;
+
+		glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			centroidMin = glm::min(centroidMin, centroids[objectIndices[i]]);
+			centroidMax = glm::max(centroidMax, centroids[objectIndices[i]]);
+		}
+
+		float bestCost = FLT_MAX;
+		int bestAxis = -1, bestSplit = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = centroidMax[axis] - centroidMin[axis];
+			if (extent <= 0.0f) continue;
+			float scale = BIN_COUNT / extent;
+
+			glm::vec3 binMin[BIN_COUNT], binMax[BIN_COUNT];
+			unsigned int binCount[BIN_COUNT] = {};
+			for (int b = 0; b < BIN_COUNT; b++)
+			{
+				binMin[b] = glm::vec3(FLT_MAX);
+				binMax[b] = glm::vec3(-FLT_MAX);
+			}
+			for (unsigned int i = first; i < first + count; i++)
+			{
+				unsigned int object = objectIndices[i];
+				int b = std::min(BIN_COUNT - 1, (int)((centroids[object][axis] - centroidMin[axis]) * scale));
+				glm::vec3 extent(bounds.extentX[object], bounds.extentY[object], bounds.extentZ[object]);
+				binCount[b]++;
+				binMin[b] = glm::min(binMin[b], centroids[object] - extent);
+				binMax[b] = glm::max(binMax[b], centroids[object] + extent);
+			}
+
+			// sweep from both sides to get the area and count left/right of every plane
+			float leftArea[BIN_COUNT - 1], rightArea[BIN_COUNT - 1];
+			unsigned int leftCounts[BIN_COUNT - 1], rightCounts[BIN_COUNT - 1];
+			glm::vec3 leftMin(FLT_MAX), leftMax(-FLT_MAX), rightMin(FLT_MAX), rightMax(-FLT_MAX);
+			unsigned int leftSum = 0, rightSum = 0;
+			for (int b = 0; b < BIN_COUNT - 1; b++)
+			{
+				leftSum += binCount[b];
+				leftCounts[b] = leftSum;
+				if (binCount[b] > 0)
+				{
+					leftMin = glm::min(leftMin, binMin[b]);
+					leftMax = glm::max(leftMax, binMax[b]);
+				}
+				leftArea[b] = leftSum > 0 ? halfArea(leftMin, leftMax) : 0.0f;
+
+				int r = BIN_COUNT - 1 - b;
+				rightSum += binCount[r];
+				rightCounts[r - 1] = rightSum;
+				if (binCount[r] > 0)
+				{
+					rightMin = glm::min(rightMin, binMin[r]);
+					rightMax = glm::max(rightMax, binMax[r]);
+				}
+				rightArea[r - 1] = rightSum > 0 ? halfArea(rightMin, rightMax) : 0.0f;
+			}
+			for (int b = 0; b < BIN_COUNT - 1; b++)
+			{
+				if (leftCounts[b] == 0 || rightCounts[b] == 0) continue;
+				float cost = leftCounts[b] * leftArea[b] + rightCounts[b] * rightArea[b];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+		if (bestAxis < 0) return false;
+		if (bestCost >= count * halfArea(node.boundsMin, node.boundsMax)) return false;
+
+		float scale = BIN_COUNT / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		unsigned int* begin = objectIndices.data() + first;
+		unsigned int* middle = std::partition(begin, begin + count, [&](unsigned int object)
+		{
+			int b = std::min(BIN_COUNT - 1, (int)((centroids[object][bestAxis] - centroidMin[bestAxis]) * scale));
+			return b <= bestSplit;
+		});
+		leftCount = (unsigned int)(middle - begin);
+		return leftCount > 0 && leftCount < count;
+	}
+
+	void appendSubtree(const BVHNode& root, std::vector<unsigned int>& out) const
+	{
+		unsigned int stack[MAX_DEPTH + 2];
+		int top = 0;
+		const BVHNode* node = &root;
+		while (true)
+		{
+			if (node->count > 0)
+			{
+				out.insert(out.end(), objectIndices.begin() + node->leftOrFirst, objectIndices.begin() + node->leftOrFirst + node->count);
+				if (top == 0) return;
+				node = &nodes[stack[--top]];
+				continue;
+			}
+			stack[top++] = node->leftOrFirst + 1;
+			node = &nodes[node->leftOrFirst];
+		}
+	}
+
+	// slab test, FLT_MAX on a miss, 0 when the origin is inside
+	static float rayBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+		glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+		float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+		return enter <= exit ? enter : FLT_MAX;
+	}
+
+	static bool sphereBox(const glm::vec3& center, float radius, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		glm::vec3 closest = glm::clamp(center, boundsMin, boundsMax);
+		glm::vec3 offset = center - closest;
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+};
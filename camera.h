@@ -2,6 +2,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "frustum.h"
 enum MovementDirection
 {
 	FORWARD,
@@ -43,6 +44,26 @@ public:
 		return glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp); // cameraPos + cameraFront ensure the camera keeps looking at the same spot while moving
 	}
 
+	glm::mat4 getProjectionMatrix(float aspect, float zNear, float zFar)
+	{
+		return glm::perspective(glm::radians(fov), aspect, zNear, zFar);
+	}
+
+	// the six planes of what this camera currently sees, for culling objects before they're submitted
+	Frustum getFrustum(float aspect, float zNear, float zFar)
+	{
+		return Frustum::fromMatrix(getProjectionMatrix(aspect, zNear, zFar) * getViewMatrix());
+	}
+
+	// world space direction of the ray through a point on screen, ndc -1..1 with y up. (0, 0) is cameraFront
+	glm::vec3 getRayDirection(float ndcX, float ndcY, float aspect)
+	{
+		float tanHalfFov = glm::tan(glm::radians(fov) * 0.5f);
+		glm::vec3 right = glm::normalize(glm::cross(cameraFront, cameraUp));
+		glm::vec3 up = glm::cross(right, cameraFront);
+		return glm::normalize(cameraFront + right * (ndcX * tanHalfFov * aspect) + up * (ndcY * tanHalfFov));
+	}
+
 	void keyboardMovement(MovementDirection direction, float deltaTime)
 	{
 		float velocity = moveSpeed * deltaTime;
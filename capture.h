@@ -0,0 +1,173 @@
+#pragma once
+#include <glad/glad.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "renderstate.h"
+
+// writes 8 bit RGBA rows as a PNG. the pixels come straight from glReadPixels so the rows are bottom up and get
+// flipped here. the image data uses stored (uncompressed) deflate blocks, bigger files but no zlib dependency
+inline bool writePNG(const std::string& path, int width, int height, const unsigned char* pixels)
+{
+    static unsigned int crcTable[256];
+    if (crcTable[1] == 0)
+    {
+        for (unsigned int n = 0; n < 256; n++)
+        {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crcTable[n] = c;
+        }
+    }
+
+    std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    auto put32 = [](std::vector<unsigned char>& out, unsigned int value)
+    {
+        out.push_back((unsigned char)(value >> 24)); out.push_back((unsigned char)(value >> 16));
+        out.push_back((unsigned char)(value >> 8)); out.push_back((unsigned char)value);
+    };
+    auto chunk = [&](const char* type, const std::vector<unsigned char>& data)
+    {
+        put32(png, (unsigned int)data.size());
+        size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        unsigned int crc = 0xFFFFFFFFu;
+        for (size_t i = start; i < png.size(); i++) crc = crcTable[(crc ^ png[i]) & 0xFF] ^ (crc >> 8);
+        put32(png, crc ^ 0xFFFFFFFFu);
+    };
+
+    std::vector<unsigned char> header;
+    put32(header, (unsigned int)width);
+    put32(header, (unsigned int)height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8 bit RGBA, no interlacing
+    chunk("IHDR", header);
+
+    // every row starts with filter type 0 (none)
+    size_t rowSize = (size_t)width * 4;
+    std::vector<unsigned char> raw;
+    raw.reserve((rowSize + 1) * height);
+    for (int y = height - 1; y >= 0; y--)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), pixels + y * rowSize, pixels + (y + 1) * rowSize);
+    }
+
+    std::vector<unsigned char> zlib = { 0x78, 0x01 };
+    for (size_t offset = 0; offset < raw.size(); offset += 65535)
+    {
+        size_t length = std::min(raw.size() - offset, (size_t)65535);
+        zlib.push_back(offset + length == raw.size() ? 1 : 0);
+        zlib.push_back((unsigned char)length); zlib.push_back((unsigned char)(length >> 8));
+        zlib.push_back((unsigned char)~length); zlib.push_back((unsigned char)(~length >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+    }
+    unsigned int a = 1, b = 0;
+    for (unsigned char byte : raw)
+    {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    put32(zlib, (b << 16) | a);
+    chunk("IDAT", zlib);
+    chunk("IEND", std::vector<unsigned char>());
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::CAPTURE::FILE_NOT_WRITTEN: " << path << std::endl;
+        return false;
+    }
+    file.write((const char*)png.data(), png.size());
+    return true;
+}
+
+// Offscreen render target for headless runs. capture() starts an asynchronous read of the finished frame into one
+// of two pixel buffers and writes out the frame before it, whose copy has had a whole frame to complete, so the
+// CPU never waits on the read it just issued.
+class FrameCapture
+{
+public:
+    unsigned int ID = 0;
+    int width = 0, height = 0;
+
+    void create(int width, int height)
+    {
+        this->width = width;
+        this->height = height;
+        glGenFramebuffers(1, &ID);
+        renderState().bindFramebuffer(GL_FRAMEBUFFER, ID);
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER::CAPTURE_INCOMPLETE" << std::endl;
+        renderState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenBuffers(2, pbos);
+        for (unsigned int pbo : pbos)
+        {
+            renderState().bindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4, NULL, GL_STREAM_READ);
+        }
+        renderState().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    void bind()
+    {
+        renderState().bindFramebuffer(GL_FRAMEBUFFER, ID);
+    }
+
+    // the frame currently in the target is written to path once the next capture() or finish() comes around
+    void capture(const std::string& path)
+    {
+        renderState().bindFramebuffer(GL_READ_FRAMEBUFFER, ID);
+        renderState().bindBuffer(GL_PIXEL_PACK_BUFFER, pbos[next]);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        renderState().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        renderState().bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        pending[next] = path;
+
+        next ^= 1;
+        write(next);
+    }
+
+    // writes whatever is still waiting in the pixel buffers
+    void finish()
+    {
+        write(next);
+        write(next ^ 1);
+    }
+
+    void destroy()
+    {
+        glDeleteFramebuffers(1, &ID);
+        glDeleteRenderbuffers(2, renderbuffers);
+        glDeleteBuffers(2, pbos);
+    }
+
+private:
+    unsigned int renderbuffers[2];
+    unsigned int pbos[2];
+    std::string pending[2];
+    int next = 0;
+
+    void write(int buffer)
+    {
+        if (pending[buffer].empty()) return;
+        renderState().bindBuffer(GL_PIXEL_PACK_BUFFER, pbos[buffer]);
+        const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (size_t)width * height * 4, GL_MAP_READ_BIT);
+        if (pixels) writePNG(pending[buffer], width, height, pixels);
+        else std::cout << "ERROR::CAPTURE::MAP_FAILED" << std::endl;
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        renderState().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        pending[buffer].clear();
+    }
+};
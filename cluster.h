@@ -0,0 +1,147 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "uniformblocks.h"
+#include "threadpool.h"
+
+// the view frustum is cut into CLUSTER_X * CLUSTER_Y screen tiles and CLUSTER_Z depth slices. slices are
+// spaced exponentially between the near and far planes so they stay roughly cube shaped with distance.
+// must match the defines in lightingShader.frag
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+// distance at which a light's attenuated intensity falls below 1/256, i.e. stops changing an 8 bit pixel
+inline float pointLightRadius(const PointLightData& light)
+{
+	float maxIntensity = std::max(std::max(light.diffuse.r, light.diffuse.g), light.diffuse.b);
+	maxIntensity = std::max(maxIntensity, std::max(std::max(light.specular.r, light.specular.g), light.specular.b));
+	maxIntensity = std::max(maxIntensity, std::max(std::max(light.ambient.r, light.ambient.g), light.ambient.b));
+	float c = light.constant - 256.0f * maxIntensity;
+	if (light.quadratic <= 0.0f)
+		return light.linear > 0.0f ? -c / light.linear : 1e30f;
+	return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) / (2.0f * light.quadratic);
+}
+
+// Assigns point lights to froxels on the CPU every frame. The result is a compact list per cluster: clusters[i]
+// holds (offset, count) into lightIndices, which is what the fragment shader walks instead of every light.
+class LightClusters
+{
+public:
+	std::vector<glm::uvec2> clusters;
+	std::vector<unsigned int> lightIndices;
+	unsigned int maxLightsPerCluster = 0;
+
+	LightClusters() : clusters(CLUSTER_COUNT), perCluster(CLUSTER_COUNT) {}
+
+	void build(const PointLightData* lights, size_t lightCount, const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar, ThreadPool& pool)
+	{
+		bounds.resize(lightCount);
+
+		// 1. per light, the range of tiles and slices its bounding sphere touches. tile boundaries are planes
+		// through the eye, x_ndc = k is the plane P00 * x + k * z = 0 in view space (same for y with P11)
+		float logDepthScale = CLUSTER_Z / std::log(zFar / zNear);
+		tileBoundaries(projection[0][0], CLUSTER_X, boundariesX);
+		tileBoundaries(projection[1][1], CLUSTER_Y, boundariesY);
+		unsigned int chunkSize = 256;
+		unsigned int chunks = (unsigned int)((lightCount + chunkSize - 1) / chunkSize);
+		pool.parallelFor(chunks, [&](unsigned int chunk)
+		{
+			size_t end = std::min(lightCount, (size_t)(chunk + 1) * chunkSize);
+			for (size_t i = (size_t)chunk * chunkSize; i < end; i++)
+			{
+				glm::vec3 center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+				float radius = lights[i].radius;
+				LightBounds& b = bounds[i];
+				b.visible = false;
+
+				float depthMin = -center.z - radius, depthMax = -center.z + radius;
+				if (depthMax < zNear || depthMin > zFar) continue;
+				b.z0 = depthSlice(std::max(depthMin, zNear), zNear, logDepthScale);
+				b.z1 = depthSlice(std::min(depthMax, zFar), zNear, logDepthScale);
+
+				if (!tileRange(center.x, center.z, radius, boundariesX, CLUSTER_X, b.x0, b.x1)) continue;
+				if (!tileRange(center.y, center.z, radius, boundariesY, CLUSTER_Y, b.y0, b.y1)) continue;
+				b.visible = true;
+			}
+		});
+
+		// 2. each depth slice is owned by exactly one task, so the per cluster lists need no locking
+		pool.parallelFor(CLUSTER_Z, [&](unsigned int slice)
+		{
+			for (unsigned int c = slice * CLUSTER_X * CLUSTER_Y; c < (slice + 1) * CLUSTER_X * CLUSTER_Y; c++)
+				perCluster[c].clear();
+			for (unsigned int i = 0; i < (unsigned int)lightCount; i++)
+			{
+				const LightBounds& b = bounds[i];
+				if (!b.visible || (int)slice < b.z0 || (int)slice > b.z1) continue;
+				for (int y = b.y0; y <= b.y1; y++)
+					for (int x = b.x0; x <= b.x1; x++)
+						perCluster[clusterIndex(x, y, slice)].push_back(i);
+			}
+		});
+
+		// 3. flatten into the offset/count table and one index list
+		lightIndices.clear();
+		maxLightsPerCluster = 0;
+		for (unsigned int c = 0; c < CLUSTER_COUNT; c++)
+		{
+			clusters[c] = glm::uvec2((unsigned int)lightIndices.size(), (unsigned int)perCluster[c].size());
+			lightIndices.insert(lightIndices.end(), perCluster[c].begin(), perCluster[c].end());
+			maxLightsPerCluster = std::max(maxLightsPerCluster, (unsigned int)perCluster[c].size());
+		}
+	}
+
+	static unsigned int clusterIndex(int x, int y, int z)
+	{
+		return (unsigned int)(x + CLUSTER_X * (y + CLUSTER_Y * z));
+	}
+
+private:
+	struct LightBounds
+	{
+		bool visible;
+		int x0, x1, y0, y1, z0, z1;
+	};
+	std::vector<LightBounds> bounds;
+	std::vector<std::vector<unsigned int>> perCluster;
+	glm::vec2 boundariesX[CLUSTER_X + 1], boundariesY[CLUSTER_Y + 1];
+
+	static int depthSlice(float depth, float zNear, float logDepthScale)
+	{
+		int slice = (int)std::floor(std::log(depth / zNear) * logDepthScale);
+		return std::min(std::max(slice, 0), CLUSTER_Z - 1);
+	}
+
+	// tile boundary k along one screen axis sits at ndc -1 + 2k / tiles, which in view space is the plane through
+	// the eye scale * coord + ndc * z = 0. stores its unit normal in the (coord, z) plane
+	static void tileBoundaries(float scale, int tiles, glm::vec2* boundaries)
+	{
+		for (int k = 0; k <= tiles; k++)
+			boundaries[k] = glm::normalize(glm::vec2(scale, -1.0f + 2.0f * k / tiles));
+	}
+
+	// first and last tile whose wedge the sphere at (coord, z) overlaps: it has to reach past the lower
+	// boundary (signed distance above -radius) and stay short of the upper one (below radius)
+	static bool tileRange(float coord, float z, float radius, const glm::vec2* boundaries, int tiles, int& first, int& last)
+	{
+		first = tiles;
+		last = -1;
+		for (int tile = 0; tile < tiles; tile++)
+		{
+			float distanceLo = boundaries[tile].x * coord + boundaries[tile].y * z;
+			float distanceHi = boundaries[tile + 1].x * coord + boundaries[tile + 1].y * z;
+			if (distanceLo > -radius && distanceHi < radius)
+			{
+				first = std::min(first, tile);
+				last = std::max(last, tile);
+			}
+		}
+		return first <= last;
+	}
+};
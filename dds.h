@@ -0,0 +1,349 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#include "stb_image.h"
+#include "mipmap.h"
+#include "assetpack.h"
+
+// S3TC is an extension that glad wasn't generated with, but every desktop driver has it
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// A block compressed image with its whole mip chain, as stored in a .dds file. levels are packed back to back
+// in data, largest first, or read in place from the mapped asset pack when mapped is set
+struct DDSImage
+{
+	unsigned int format = 0; // the GL_COMPRESSED_* internal format
+	int width = 0, height = 0;
+	std::vector<unsigned char> data;
+	const unsigned char* mapped = NULL;
+	std::vector<size_t> levelOffsets, levelSizes;
+
+	const unsigned char* bytes() const { return mapped ? mapped : data.data(); }
+	size_t byteSize() const { return levelOffsets.empty() ? 0 : levelOffsets.back() + levelSizes.back(); }
+	int levelCount() const { return (int)levelOffsets.size(); }
+	int levelWidth(int level) const { return std::max(1, width >> level); }
+	int levelHeight(int level) const { return std::max(1, height >> level); }
+};
+
+inline int ddsBlockSize(unsigned int format)
+{
+	return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1 ? 8 : 16;
+}
+
+inline size_t ddsLevelSize(unsigned int format, int width, int height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * ddsBlockSize(format);
+}
+
+// ---------------------------------------------------------------------------------------------------------------
+// block encoders. every block is 4x4 RGBA8 pixels, row major
+
+inline unsigned short packRGB565(const float* color)
+{
+	int r = std::min(31, std::max(0, (int)(color[0] * 31.0f / 255.0f + 0.5f)));
+	int g = std::min(63, std::max(0, (int)(color[1] * 63.0f / 255.0f + 0.5f)));
+	int b = std::min(31, std::max(0, (int)(color[2] * 31.0f / 255.0f + 0.5f)));
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+inline void unpackRGB565(unsigned short packed, float* color)
+{
+	color[0] = (float)((packed >> 11) & 31) * 255.0f / 31.0f;
+	color[1] = (float)((packed >> 5) & 63) * 255.0f / 63.0f;
+	color[2] = (float)(packed & 31) * 255.0f / 31.0f;
+}
+
+// endpoints are the extremes of the pixels projected onto their principal axis (a few power iterations on the
+// covariance), always in the 4 colour mode so the block never turns transparent
+inline void encodeBC1Block(const unsigned char* pixels, unsigned char* out)
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++) mean[c] += pixels[i * 4 + c] / 16.0f;
+	float covariance[6] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float d[3] = { pixels[i * 4] - mean[0], pixels[i * 4 + 1] - mean[1], pixels[i * 4 + 2] - mean[2] };
+		covariance[0] += d[0] * d[0]; covariance[1] += d[0] * d[1]; covariance[2] += d[0] * d[2];
+		covariance[3] += d[1] * d[1]; covariance[4] += d[1] * d[2]; covariance[5] += d[2] * d[2];
+	}
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[3] = {
+			covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+			covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+			covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] };
+		float length = std::max(std::max(std::fabs(next[0]), std::fabs(next[1])), std::fabs(next[2]));
+		if (length < 1e-6f) break;
+		for (int c = 0; c < 3; c++) axis[c] = next[c] / length;
+	}
+
+	float minProjection = 1e30f, maxProjection = -1e30f;
+	int minPixel = 0, maxPixel = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		float projection = (pixels[i * 4] - mean[0]) * axis[0] + (pixels[i * 4 + 1] - mean[1]) * axis[1] + (pixels[i * 4 + 2] - mean[2]) * axis[2];
+		if (projection < minProjection) { minProjection = projection; minPixel = i; }
+		if (projection > maxProjection) { maxProjection = projection; maxPixel = i; }
+	}
+	float maxColor[3] = { (float)pixels[maxPixel * 4], (float)pixels[maxPixel * 4 + 1], (float)pixels[maxPixel * 4 + 2] };
+	float minColor[3] = { (float)pixels[minPixel * 4], (float)pixels[minPixel * 4 + 1], (float)pixels[minPixel * 4 + 2] };
+	unsigned short color0 = packRGB565(maxColor), color1 = packRGB565(minColor);
+	if (color0 < color1) std::swap(color0, color1);
+
+	unsigned int indices = 0;
+	if (color0 != color1)
+	{
+		float palette[4][3];
+		unpackRGB565(color0, palette[0]);
+		unpackRGB565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			float bestError = 1e30f;
+			for (int p = 0; p < 4; p++)
+			{
+				float error = 0.0f;
+				for (int c = 0; c < 3; c++) error += (pixels[i * 4 + c] - palette[p][c]) * (pixels[i * 4 + c] - palette[p][c]);
+				if (error < bestError) { bestError = error; best = p; }
+			}
+			indices |= (unsigned int)best << (i * 2);
+		}
+	}
+	out[0] = (unsigned char)color0; out[1] = (unsigned char)(color0 >> 8);
+	out[2] = (unsigned char)color1; out[3] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; i++) out[4 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// one channel (at channel bytes into each pixel) in the 8 value mode spanning the block's min and max
+inline void encodeBC4Block(const unsigned char* pixels, int channel, unsigned char* out)
+{
+	int lo = 255, hi = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		lo = std::min(lo, (int)pixels[i * 4 + channel]);
+		hi = std::max(hi, (int)pixels[i * 4 + channel]);
+	}
+	out[0] = (unsigned char)hi;
+	out[1] = (unsigned char)lo;
+	unsigned long long indices = 0;
+	if (hi > lo)
+	{
+		// palette order is hi, lo, then 6 steps from hi towards lo
+		static const int order[8] = { 0, 2, 3, 4, 5, 6, 7, 1 };
+		for (int i = 0; i < 16; i++)
+		{
+			int step = (int)((pixels[i * 4 + channel] - lo) * 7.0f / (hi - lo) + 0.5f);
+			indices |= (unsigned long long)order[7 - step] << (i * 3);
+		}
+	}
+	for (int i = 0; i < 6; i++) out[2 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+inline void encodeBlock(unsigned int format, const unsigned char* pixels, unsigned char* out)
+{
+	if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) encodeBC1Block(pixels, out);
+	else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+	{
+		encodeBC4Block(pixels, 3, out);
+		encodeBC1Block(pixels, out + 8);
+	}
+	else if (format == GL_COMPRESSED_RED_RGTC1) encodeBC4Block(pixels, 0, out);
+	else if (format == GL_COMPRESSED_RG_RGTC2)
+	{
+		encodeBC4Block(pixels, 0, out);
+		encodeBC4Block(pixels, 1, out + 8);
+	}
+}
+
+// compresses RGBA8 pixels and every mip below them. the mips are filtered in linear light when srgb is set
+inline DDSImage compressImage(const unsigned char* pixels, int width, int height, unsigned int format, bool srgb = true)
+{
+	DDSImage image;
+	image.format = format;
+	image.width = width;
+	image.height = height;
+	std::vector<std::vector<unsigned char>> mips = generateMipChain(pixels, width, height, MIP_KAISER, srgb);
+	const unsigned char* level = pixels;
+	int levelWidth = width, levelHeight = height;
+	for (size_t mip = 0; ; mip++)
+	{
+		size_t offset = image.data.size();
+		image.levelOffsets.push_back(offset);
+		image.levelSizes.push_back(ddsLevelSize(format, levelWidth, levelHeight));
+		image.data.resize(offset + image.levelSizes.back());
+		unsigned char* out = &image.data[offset];
+		unsigned char block[64];
+		for (int by = 0; by < levelHeight; by += 4)
+			for (int bx = 0; bx < levelWidth; bx += 4)
+			{
+				// blocks hanging over the edge repeat the edge pixels
+				for (int y = 0; y < 4; y++)
+					for (int x = 0; x < 4; x++)
+					{
+						int sx = std::min(bx + x, levelWidth - 1), sy = std::min(by + y, levelHeight - 1);
+						memcpy(block + (y * 4 + x) * 4, &level[((size_t)sy * levelWidth + sx) * 4], 4);
+					}
+				encodeBlock(format, block, out);
+				out += ddsBlockSize(format);
+			}
+		if (mip == mips.size()) break;
+		level = mips[mip].data();
+		levelWidth = std::max(1, levelWidth / 2);
+		levelHeight = std::max(1, levelHeight / 2);
+	}
+	return image;
+}
+
+// ---------------------------------------------------------------------------------------------------------------
+// .dds files: "DDS ", a 124 byte header, optionally the 20 byte DX10 header, then the levels
+
+#define DDS_FOURCC(a, b, c, d) ((unsigned int)(a) | ((unsigned int)(b) << 8) | ((unsigned int)(c) << 16) | ((unsigned int)(d) << 24))
+
+inline bool writeDDS(const char* path, const DDSImage& image)
+{
+	unsigned int fourCC = 0;
+	if (image.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) fourCC = DDS_FOURCC('D', 'X', 'T', '1');
+	else if (image.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) fourCC = DDS_FOURCC('D', 'X', 'T', '5');
+	else if (image.format == GL_COMPRESSED_RED_RGTC1) fourCC = DDS_FOURCC('A', 'T', 'I', '1');
+	else if (image.format == GL_COMPRESSED_RG_RGTC2) fourCC = DDS_FOURCC('A', 'T', 'I', '2');
+
+	unsigned int header[32] = {};
+	header[0] = DDS_FOURCC('D', 'D', 'S', ' ');
+	header[1] = 124;
+	header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip count, linear size
+	header[3] = (unsigned int)image.height;
+	header[4] = (unsigned int)image.width;
+	header[5] = (unsigned int)image.levelSizes[0];
+	header[7] = (unsigned int)image.levelCount();
+	header[19] = 32; // pixel format size
+	header[20] = 0x4; // fourcc
+	header[21] = fourCC;
+	header[27] = 0x1000 | 0x400000 | 0x8; // texture, mipmap, complex
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cout << "ERROR::DDS::FILE_NOT_WRITTEN: " << path << std::endl;
+		return false;
+	}
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)image.bytes(), image.byteSize());
+	return true;
+}
+
+// BC1/BC3/BC4/BC5 by fourcc, and BC7 through the DX10 header so files from other tools load too. a file that's
+// in the asset pack isn't copied, the image points at its levels inside the mapping
+inline bool loadDDS(const char* path, DDSImage& image)
+{
+	AssetFile file(path);
+	const unsigned int* header = (const unsigned int*)file.data();
+	if (file.size() < 128 || header[0] != DDS_FOURCC('D', 'D', 'S', ' '))
+	{
+		std::cout << "ERROR::DDS::FILE_NOT_READ: " << path << std::endl;
+		return false;
+	}
+	size_t headerSize = 128;
+	unsigned int fourCC = header[21];
+	image.format = 0;
+	if (fourCC == DDS_FOURCC('D', 'X', 'T', '1')) image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	else if (fourCC == DDS_FOURCC('D', 'X', 'T', '5')) image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	else if (fourCC == DDS_FOURCC('A', 'T', 'I', '1') || fourCC == DDS_FOURCC('B', 'C', '4', 'U')) image.format = GL_COMPRESSED_RED_RGTC1;
+	else if (fourCC == DDS_FOURCC('A', 'T', 'I', '2') || fourCC == DDS_FOURCC('B', 'C', '5', 'U')) image.format = GL_COMPRESSED_RG_RGTC2;
+	else if (fourCC == DDS_FOURCC('D', 'X', '1', '0') && file.size() >= 148)
+	{
+		unsigned int dxgiFormat = header[32];
+		headerSize = 148;
+		if (dxgiFormat == 98) image.format = GL_COMPRESSED_RGBA_BPTC_UNORM;
+		else if (dxgiFormat == 99) image.format = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+	}
+	if (image.format == 0)
+	{
+		std::cout << "ERROR::DDS::UNSUPPORTED_FORMAT: " << path << std::endl;
+		return false;
+	}
+
+	image.height = (int)header[3];
+	image.width = (int)header[4];
+	int levels = std::max(1, (int)header[7]);
+	image.levelOffsets.clear();
+	image.levelSizes.clear();
+	size_t total = 0;
+	for (int level = 0; level < levels; level++)
+	{
+		image.levelOffsets.push_back(total);
+		image.levelSizes.push_back(ddsLevelSize(image.format, image.levelWidth(level), image.levelHeight(level)));
+		total += image.levelSizes.back();
+	}
+	if (file.size() < headerSize + total)
+	{
+		std::cout << "ERROR::DDS::TRUNCATED: " << path << std::endl;
+		return false;
+	}
+	const unsigned char* levelData = file.data() + headerSize;
+	image.mapped = NULL;
+	image.data.clear();
+	if (file.mapped()) image.mapped = levelData;
+	else image.data.assign(levelData, levelData + total);
+	return true;
+}
+
+// the offline half: image file in, .dds with a full mip chain out. format is bc1, bc3, bc4 or bc5; empty picks
+// bc3 when the source has any transparency and bc1 otherwise. linear marks a data map (specular, roughness) stored
+// in bc1/bc3, whose mips are then filtered as stored rather than as sRGB colour
+inline bool bakeTexture(const char* input, const char* output, const std::string& format, bool linear = false)
+{
+	int width, height, channels;
+	stbi_set_flip_vertically_on_load(true);
+	unsigned char* pixels = stbi_load(input, &width, &height, &channels, 4);
+	if (!pixels)
+	{
+		std::cout << "ERROR::DDS::SOURCE_NOT_READ: " << input << std::endl;
+		return false;
+	}
+
+	unsigned int glFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	if (format == "bc3") glFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	else if (format == "bc4") glFormat = GL_COMPRESSED_RED_RGTC1;
+	else if (format == "bc5") glFormat = GL_COMPRESSED_RG_RGTC2;
+	else if (format.empty())
+	{
+		for (size_t i = 0; i < (size_t)width * height; i++)
+			if (pixels[i * 4 + 3] != 255) { glFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break; }
+	}
+	else if (format != "bc1") std::cout << "ERROR::DDS::UNKNOWN_FORMAT: " << format << ", using bc1" << std::endl;
+
+	// bc4/bc5 hold data (masks, normals) rather than colours, so their mips are filtered as stored
+	bool srgb = !linear && (glFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || glFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+	DDSImage image = compressImage(pixels, width, height, glFormat, srgb);
+	stbi_image_free(pixels);
+	return writeDDS(output, image);
+}
+
+// uploads every level to the bound GL_TEXTURE_2D. data is image.bytes() in client memory, or the offset of a copy
+// of them in the bound GL_PIXEL_UNPACK_BUFFER
+inline void uploadDDS(const DDSImage& image, const void* data)
+{
+	for (int level = 0; level < image.levelCount(); level++)
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, image.format, image.levelWidth(level), image.levelHeight(level), 0,
+			(GLsizei)image.levelSizes[level], (const char*)data + image.levelOffsets[level]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levelCount() - 1);
+}
@@ -0,0 +1,34 @@
+#version 460 core
+
+#include "frameData.glsl"
+#include "lights.glsl"
+
+layout (binding = 2) uniform sampler2D gPosition;
+layout (binding = 3) uniform sampler2D gNormal;
+layout (binding = 4) uniform sampler2D gAlbedo;
+layout (binding = 5) uniform sampler2D gSpecular;
+
+uniform float shininess;
+
+out vec4 FragColor;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 fragPos = texelFetch(gPosition, pixel, 0);
+    if (fragPos.w == 0.0) discard;
+    vec3 normal = texelFetch(gNormal, pixel, 0).xyz;
+    vec3 albedo = texelFetch(gAlbedo, pixel, 0).rgb;
+    vec3 specularColor = texelFetch(gSpecular, pixel, 0).rgb;
+    vec3 viewDir = normalize(viewPos - fragPos.xyz);
+
+    // same terms as CalcDirLight in lightingShader.frag
+    vec3 lightDir = normalize(-dirLight.direction);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    vec3 ambient  = dirLight.ambient  * albedo;
+    vec3 diffuse  = dirLight.diffuse  * diff * albedo;
+    vec3 specular = dirLight.specular * spec * specularColor;
+    FragColor = vec4(ambient + diffuse + specular, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#version 460 core
+// light volume: the unit cube scaled to enclose each light's radius, one instance per light
+layout (location = 0) in vec3 aPos;
+
+#include "frameData.glsl"
+#include "lights.glsl"
+
+flat out int lightIndex;
+
+void main()
+{
+   PointLight light = pointLights[gl_InstanceID];
+   lightIndex = gl_InstanceID;
+   gl_Position = projection * view * vec4(light.position + aPos * 2.0 * light.radius, 1.0);
+}
\ No newline at end of file
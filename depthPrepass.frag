@@ -0,0 +1,6 @@
+#version 460 core
+// nothing to write, the pre-pass only fills the depth buffer
+
+void main()
+{
+};
@@ -0,0 +1,27 @@
+#version 460 core
+// depth pre-pass: positions only, computed exactly the way lightingShader.vert does so the shading pass after it
+// can test with GL_EQUAL. invariant on both sides is what guarantees the same depth from the two programs
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in mat4 aModel; // per instance, locations 3-6
+
+#include "frameData.glsl"
+
+#ifdef MULTI_DRAW
+#include "drawData.glsl"
+layout (std430, binding = 5) readonly buffer DrawDataBlock
+{
+   DrawData draws[];
+};
+#endif
+
+invariant gl_Position;
+
+void main()
+{
+#ifdef MULTI_DRAW
+   mat4 model = draws[gl_DrawID].model;
+#else
+   mat4 model = aModel;
+#endif
+   gl_Position = projection * view * model * vec4(aPos, 1.0);
+};
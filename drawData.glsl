@@ -0,0 +1,6 @@
+// one draw of a multi-draw indirect batch, read with gl_DrawID (see DrawData in uniformblocks.h)
+struct DrawData
+{
+   mat4 model;
+   mat3 normalMatrix;
+};
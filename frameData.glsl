@@ -0,0 +1,10 @@
+// per frame constants, uploaded once per frame into binding 0 (see FrameData in uniformblocks.h)
+layout (std140, binding = 0) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	float zNear;
+	vec2 screenSize;
+	float zFar;
+};
@@ -0,0 +1,102 @@
+#pragma once
+#include <glad/glad.h>
+#include <iostream>
+
+#include "renderstate.h"
+
+// Geometry buffer for deferred shading: world position (w = 1 where geometry was drawn), normal, albedo and
+// specular colour, plus a depth/stencil texture that can be blitted to the default framebuffer afterwards
+class GBuffer
+{
+public:
+    unsigned int ID;
+    unsigned int position, normal, albedo, specular, depth;
+    int width = 0, height = 0;
+    unsigned int output = 0; // where the lighting passes draw, the default framebuffer unless rendering offscreen
+
+    GBuffer(int width, int height)
+    {
+        glGenFramebuffers(1, &ID);
+        create(width, height);
+    }
+
+    // the attachments have to follow the window size, called every frame and only rebuilds on a change
+    void resize(int width, int height)
+    {
+        if (width == this->width && height == this->height) return;
+        destroyAttachments();
+        create(width, height);
+    }
+
+    void bind()
+    {
+        renderState().bindFramebuffer(GL_FRAMEBUFFER, ID);
+    }
+
+    void unbind()
+    {
+        renderState().bindFramebuffer(GL_FRAMEBUFFER, output);
+    }
+
+    // position, normal, albedo and specular go to units firstUnit to firstUnit + 3
+    void bindTextures(unsigned int firstUnit)
+    {
+        unsigned int textures[] = { position, normal, albedo, specular };
+        for (unsigned int i = 0; i < 4; i++)
+            renderState().bindTexture(firstUnit + i, textures[i]);
+        renderState().activeTexture(0);
+    }
+
+    // copies the depth written by the geometry pass so forward drawn objects depth test against the scene
+    void blitDepthToOutput()
+    {
+        renderState().bindFramebuffer(GL_READ_FRAMEBUFFER, ID);
+        renderState().bindFramebuffer(GL_DRAW_FRAMEBUFFER, output);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        renderState().bindFramebuffer(GL_FRAMEBUFFER, output);
+    }
+
+    void destroy()
+    {
+        destroyAttachments();
+        glDeleteFramebuffers(1, &ID);
+    }
+
+private:
+    unsigned int createAttachment(unsigned int internalFormat, unsigned int format, unsigned int type, unsigned int attachment)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        renderState().bindTexture(RENDERSTATE_SCRATCH_UNIT, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+        return texture;
+    }
+
+    void create(int width, int height)
+    {
+        this->width = width > 0 ? width : 1;
+        this->height = height > 0 ? height : 1;
+        renderState().bindFramebuffer(GL_FRAMEBUFFER, ID);
+        position = createAttachment(GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_COLOR_ATTACHMENT0);
+        normal = createAttachment(GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_COLOR_ATTACHMENT1);
+        albedo = createAttachment(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT2);
+        specular = createAttachment(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT3);
+        depth = createAttachment(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, GL_DEPTH_STENCIL_ATTACHMENT);
+        unsigned int drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+        glDrawBuffers(4, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER::GBUFFER_INCOMPLETE" << std::endl;
+        renderState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void destroyAttachments()
+    {
+        unsigned int textures[] = { position, normal, albedo, specular, depth };
+        renderState().deleteTextures(5, textures);
+    }
+};
@@ -0,0 +1,153 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <immintrin.h>
+#define FRUSTUM_SSE
+#endif
+#if defined(__AVX__)
+#define FRUSTUM_AVX
+#endif
+
+// Six inward facing planes (xyz = unit normal, w = distance), pulled straight out of a view-projection matrix
+// (Gribb and Hartmann). A point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all six.
+struct Frustum
+{
+	enum { PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR };
+	glm::vec4 planes[6];
+
+	static Frustum fromMatrix(const glm::mat4& viewProjection)
+	{
+		const glm::mat4& m = viewProjection;
+		glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+		glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+		glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+		glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+		Frustum frustum;
+		frustum.planes[PLANE_LEFT] = row3 + row0;
+		frustum.planes[PLANE_RIGHT] = row3 - row0;
+		frustum.planes[PLANE_BOTTOM] = row3 + row1;
+		frustum.planes[PLANE_TOP] = row3 - row1;
+		frustum.planes[PLANE_NEAR] = row3 + row2;
+		frustum.planes[PLANE_FAR] = row3 - row2;
+		for (glm::vec4& plane : frustum.planes)
+			plane /= glm::length(glm::vec3(plane));
+		return frustum;
+	}
+
+	// center/extent box test: the box is out once even its corner furthest along the normal is behind a plane
+	bool intersectsAABB(const glm::vec3& center, const glm::vec3& extent) const
+	{
+		for (const glm::vec4& plane : planes)
+		{
+			float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+			if (distance + radius < 0.0f) return false;
+		}
+		return true;
+	}
+
+	// -1 when the box is fully outside, 1 when it's fully inside every plane, 0 when it straddles one
+	int classifyAABB(const glm::vec3& center, const glm::vec3& extent) const
+	{
+		int result = 1;
+		for (const glm::vec4& plane : planes)
+		{
+			float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+			if (distance + radius < 0.0f) return -1;
+			if (distance - radius < 0.0f) result = 0;
+		}
+		return result;
+	}
+};
+
+// world space boxes as center and half extent, stored per component so the culler can load 4 or 8 at once
+struct BoundsList
+{
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+	size_t size() const { return centerX.size(); }
+
+	void resize(size_t count)
+	{
+		for (std::vector<float>* component : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ })
+			component->resize(count);
+	}
+
+	void set(size_t i, const glm::vec3& center, const glm::vec3& extent)
+	{
+		centerX[i] = center.x; centerY[i] = center.y; centerZ[i] = center.z;
+		extentX[i] = extent.x; extentY[i] = extent.y; extentZ[i] = extent.z;
+	}
+
+	// the world box of a local box (center, extent) after an affine transform: each world axis picks up the
+	// absolute contribution of every local axis
+	void setTransformed(size_t i, const glm::mat4& model, const glm::vec3& localCenter, const glm::vec3& localExtent)
+	{
+		glm::vec3 center = glm::vec3(model * glm::vec4(localCenter, 1.0f));
+		glm::vec3 extent = glm::abs(glm::vec3(model[0])) * localExtent.x
+			+ glm::abs(glm::vec3(model[1])) * localExtent.y
+			+ glm::abs(glm::vec3(model[2])) * localExtent.z;
+		set(i, center, extent);
+	}
+};
+
+// appends the index of every box that intersects the frustum to visible, returns how many were added.
+// 8 boxes per iteration with AVX, 4 with SSE, one at a time for the remainder
+inline size_t cullBounds(const Frustum& frustum, const BoundsList& bounds, std::vector<unsigned int>& visible)
+{
+	size_t count = bounds.size();
+	size_t before = visible.size();
+	size_t i = 0;
+#ifdef FRUSTUM_AVX
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&bounds.centerX[i]), cy = _mm256_loadu_ps(&bounds.centerY[i]), cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+		__m256 ex = _mm256_loadu_ps(&bounds.extentX[i]), ey = _mm256_loadu_ps(&bounds.extentY[i]), ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+		__m256 outside = _mm256_setzero_ps();
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), cx), _mm256_mul_ps(_mm256_set1_ps(plane.y), cy)),
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), cz), _mm256_set1_ps(plane.w)));
+			__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.x)), ex), _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.y)), ey)),
+				_mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.z)), ez));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+		int mask = ~_mm256_movemask_ps(outside) & 0xFF;
+		for (int lane = 0; lane < 8; lane++)
+			if (mask & (1 << lane)) visible.push_back((unsigned int)(i + lane));
+	}
+#endif
+#ifdef FRUSTUM_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&bounds.centerX[i]), cy = _mm_loadu_ps(&bounds.centerY[i]), cz = _mm_loadu_ps(&bounds.centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&bounds.extentX[i]), ey = _mm_loadu_ps(&bounds.extentY[i]), ez = _mm_loadu_ps(&bounds.extentZ[i]);
+		__m128 outside = _mm_setzero_ps();
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(plane.x)), ex), _mm_mul_ps(_mm_set1_ps(std::fabs(plane.y)), ey)),
+				_mm_mul_ps(_mm_set1_ps(std::fabs(plane.z)), ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+		int mask = ~_mm_movemask_ps(outside) & 0xF;
+		for (int lane = 0; lane < 4; lane++)
+			if (mask & (1 << lane)) visible.push_back((unsigned int)(i + lane));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+		glm::vec3 extent(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+		if (frustum.intersectsAABB(center, extent)) visible.push_back((unsigned int)i);
+	}
+	return visible.size() - before;
+}
@@ -0,0 +1,20 @@
+#version 460 core
+// geometry pass of the deferred path, paired with lightingShader.vert
+layout (location = 0) out vec4 gPosition;
+layout (location = 1) out vec4 gNormal;
+layout (location = 2) out vec4 gAlbedo;
+layout (location = 3) out vec4 gSpecular;
+
+#include "material.glsl"
+
+in vec3 Normal;
+in vec3 FragPos;
+in vec2 TexCoords;
+
+void main()
+{
+    gPosition = vec4(FragPos, 1.0); // w = 1 tells the lighting passes this pixel has geometry
+    gNormal = vec4(normalize(Normal), 0.0);
+    gAlbedo = vec4(texture(material.diffuse, TexCoords).rgb, 1.0);
+    gSpecular = vec4(materialSpecular(TexCoords), 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,165 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <iostream>
+#include <cstdlib>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "buffer.h"
+#include "frustum.h"
+#include "renderstate.h"
+#include "renderqueue.h"
+#include "multidraw.h"
+#include "hiz.h"
+#include "uniformblocks.h"
+
+#define GPU_CULLING_GROUP_SIZE 64 // local_size_x in cullObjects.comp
+
+// the reference cullObjects.comp is checked against: the same box test, in object order
+inline void cullObjectsCPU(const Frustum& frustum, const std::vector<CullTransform>& transforms, std::vector<unsigned int>& visible)
+{
+	visible.clear();
+	for (size_t i = 0; i < transforms.size(); i++)
+		if (frustum.intersectsAABB(glm::vec3(transforms[i].center), glm::vec3(transforms[i].extent))) visible.push_back((unsigned int)i);
+}
+
+// Frustum culling, plus occlusion culling against a HiZBuffer, as a compute pass. Every object's mesh range stays
+// resident on the GPU and only its transform and bounds go up each frame, and the survivors come out compacted into
+// an indirect command buffer plus the DrawData the MULTI_DRAW vertex shader reads, normal matrix included, with no
+// per object test or copy on the CPU. The draw count stays on the GPU too, the draw reads it with
+// glMultiDrawElementsIndirectCount. Compaction goes through an atomic counter, so the survivors lose their order,
+// and sorting them beforehand buys nothing
+class GPUCuller
+{
+public:
+	// changed by the caller only when the objects do, followed by uploadObjects()
+	std::vector<CullObject> objects;
+	// filled by the caller every frame before cull(), one for each object
+	std::vector<CullTransform> transforms;
+	ShaderStorageBuffer objectBuffer, transformBuffer, commandBuffer, drawDataBuffer, resultBuffer;
+	// what got drawn and what the Hi-Z test removed, read back PERSISTENT_BUFFER_FRAMES frames late so they never stall
+	unsigned int drawn = 0, occluded = 0;
+	// last verify()'s survivor counts and how many objects the two disagreed on
+	unsigned int gpuVisible = 0, cpuVisible = 0, mismatches = 0;
+
+	GPUCuller()
+		: objectBuffer(0, CULL_OBJECT_STORAGE_BINDING), transformBuffer(0, CULL_TRANSFORM_STORAGE_BINDING), commandBuffer(0, CULL_COMMAND_STORAGE_BINDING),
+		drawDataBuffer(0, DRAW_DATA_STORAGE_BINDING), resultBuffer(0, CULL_RESULT_STORAGE_BINDING),
+		counters(GL_COPY_WRITE_BUFFER, 4, GL_MAP_READ_BIT), shader("cullObjects.comp")
+	{
+		planesLocation = shader.getUniformLocation("frustumPlanes");
+		countLocation = shader.getUniformLocation("objectCount");
+		hiZEnabledLocation = shader.getUniformLocation("hiZEnabled");
+		hiZMatrixLocation = shader.getUniformLocation("hiZViewProjection");
+		shader.use();
+		glUniform1i(shader.getUniformLocation("hiZ"), HIZ_TEXTURE_UNIT);
+	}
+
+	void uploadObjects()
+	{
+		objectBuffer.update(objects.data(), (unsigned int)(objects.size() * sizeof(CullObject)));
+	}
+
+	// uploads the transforms, culls the objects against the frustum, and against hiZ when it's given and valid, and
+	// leaves the results ready for drawing
+	void cull(const Frustum& frustum, const HiZBuffer* hiZ = NULL)
+	{
+		lastFrustum = frustum;
+		lastOcclusion = hiZ && hiZ->valid;
+		unsigned int count = (unsigned int)transforms.size();
+		transformBuffer.update(transforms.data(), count * sizeof(CullTransform));
+		commandBuffer.reserve(count * sizeof(DrawElementsIndirectCommand));
+		drawDataBuffer.reserve(count * sizeof(DrawData));
+		resultBuffer.reserve((2 * count + 2) * sizeof(unsigned int));
+		unsigned int zero[2] = {};
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero);
+
+		// binding 5 is shared with MultiDrawBatch, which points it at its own buffer
+		renderState().bindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_STORAGE_BINDING, drawDataBuffer.ID);
+		shader.use();
+		glUniform4fv(planesLocation, 6, &frustum.planes[0].x);
+		glUniform1ui(countLocation, count);
+		glUniform1i(hiZEnabledLocation, lastOcclusion);
+		if (lastOcclusion)
+		{
+			glUniformMatrix4fv(hiZMatrixLocation, 1, GL_FALSE, &hiZ->viewProjection[0][0]);
+			renderState().bindTexture(HIZ_TEXTURE_UNIT, hiZ->pyramid);
+			renderState().activeTexture(0);
+		}
+		shader.dispatch(count, GPU_CULLING_GROUP_SIZE);
+		// the commands and the count are read by the draw, the draw data by its vertex shader, the counters by the copy
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		// the region handed out last held the counters from PERSISTENT_BUFFER_FRAMES frames ago, this frame's go in
+		// its place
+		const unsigned int* previous = (const unsigned int*)counters.begin(2 * sizeof(unsigned int));
+		if (countersCopied >= PERSISTENT_BUFFER_FRAMES)
+		{
+			drawn = previous[0];
+			occluded = previous[1];
+		}
+		renderState().bindBuffer(GL_COPY_READ_BUFFER, resultBuffer.ID);
+		renderState().bindBuffer(GL_COPY_WRITE_BUFFER, counters.ID);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, counters.offset(), 2 * sizeof(unsigned int));
+		counters.end();
+		countersCopied++;
+	}
+
+	// what to hand the render queue: up to every object, as many as the count at the start of resultBuffer says
+	void fillDraw(DrawCommand& draw) const
+	{
+		draw.indirectBuffer = commandBuffer.ID;
+		draw.indirectOffset = 0;
+		draw.drawCount = (unsigned int)transforms.size();
+		draw.countBuffer = resultBuffer.ID;
+	}
+
+	// reads the last cull's survivors back (a full stall, this is for checking the compute shader, not for every
+	// frame) and compares them against cullObjectsCPU on the same objects and frustum. the CPU reference has no
+	// occlusion test, so with Hi-Z on the objects only it kept have to be exactly the ones the GPU listed as occluded.
+	// returns the mismatches
+	unsigned int verify()
+	{
+		unsigned int count = (unsigned int)transforms.size();
+		std::vector<unsigned int> results(2 * count + 2, 0);
+		renderState().bindBuffer(GL_SHADER_STORAGE_BUFFER, resultBuffer.ID);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, results.size() * sizeof(unsigned int), results.data());
+		gpuVisible = std::min(results[0], count);
+		unsigned int gpuOccluded = lastOcclusion ? std::min(results[1], count) : 0;
+		std::vector<unsigned int> gpu(results.begin() + 2, results.begin() + 2 + gpuVisible), cpu;
+		std::vector<unsigned int> occludedObjects(results.begin() + 2 + count, results.begin() + 2 + count + gpuOccluded);
+		std::sort(gpu.begin(), gpu.end());
+		std::sort(occludedObjects.begin(), occludedObjects.end());
+		cullObjectsCPU(lastFrustum, transforms, cpu);
+		cpuVisible = (unsigned int)cpu.size();
+
+		// visible on the GPU but not the CPU, and the two ways the CPU only set can differ from the occluded list
+		std::vector<unsigned int> gpuOnly, cpuOnly, unexplained, wronglyOccluded;
+		std::set_difference(gpu.begin(), gpu.end(), cpu.begin(), cpu.end(), std::back_inserter(gpuOnly));
+		std::set_difference(cpu.begin(), cpu.end(), gpu.begin(), gpu.end(), std::back_inserter(cpuOnly));
+		std::set_difference(cpuOnly.begin(), cpuOnly.end(), occludedObjects.begin(), occludedObjects.end(), std::back_inserter(unexplained));
+		std::set_difference(occludedObjects.begin(), occludedObjects.end(), cpuOnly.begin(), cpuOnly.end(), std::back_inserter(wronglyOccluded));
+		mismatches = (unsigned int)(gpuOnly.size() + unexplained.size() + wronglyOccluded.size());
+		if (mismatches > 0) std::cout << "ERROR::GPUCULLING::MISMATCH: " << mismatches << " objects, " << gpuVisible << " visible on the GPU, " << cpuVisible << " on the CPU" << std::endl;
+		return mismatches;
+	}
+
+	void destroy()
+	{
+		shader.destroy();
+		counters.destroy();
+		unsigned int buffers[] = { objectBuffer.ID, transformBuffer.ID, commandBuffer.ID, drawDataBuffer.ID, resultBuffer.ID };
+		renderState().deleteBuffers(5, buffers);
+	}
+
+private:
+	PersistentBuffer counters;
+	unsigned int countersCopied = 0;
+	ComputeShader shader;
+	int planesLocation, countLocation, hiZEnabledLocation, hiZMatrixLocation;
+	Frustum lastFrustum;
+	bool lastOcclusion = false;
+};
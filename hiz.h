@@ -0,0 +1,128 @@
+#pragma once
+#include <glad/glad.h>
+#include <algorithm>
+#include <iostream>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "renderstate.h"
+
+#define HIZ_TEXTURE_UNIT 6 // the G-buffer's textures are on 2 to 5
+#define HIZ_GROUP_SIZE 8 // local_size_x and _y in hiZ.comp
+
+// Hierarchical Z: a depth pyramid where every texel holds the farthest depth under it, so a box's screen rectangle
+// can be checked against the scene with 4 fetches from the level where it covers about 2x2 texels. It's built at
+// the end of a frame from that frame's depth and tested against during the next, with the matrix it was rendered
+// with, so something that was hidden last frame stays culled for one frame after it comes into view.
+// Level 0 is the screen size rounded down to powers of two
+class HiZBuffer
+{
+public:
+	unsigned int pyramid = 0; // R32F, every level allocated
+	unsigned int depth = 0; // a copy of the screen's depth buffer, the source for level 0
+	int width = 0, height = 0, levels = 0; // of level 0
+	glm::mat4 viewProjection = glm::mat4(1.0f); // of the frame the pyramid was built from
+	bool valid = false; // nothing to test against until the first build after a resize
+
+	HiZBuffer() : shader("hiZ.comp")
+	{
+		glGenFramebuffers(1, &framebuffer);
+		fromDepthLocation = shader.getUniformLocation("fromDepth");
+		sourceSizeLocation = shader.getUniformLocation("sourceSize");
+		shader.use();
+		glUniform1i(shader.getUniformLocation("depthTexture"), HIZ_TEXTURE_UNIT);
+	}
+
+	// copies the depth of source, which is screenWidth x screenHeight, and reduces it level by level down to 1x1
+	void build(unsigned int source, int screenWidth, int screenHeight, const glm::mat4& viewProjection)
+	{
+		resize(screenWidth, screenHeight);
+		renderState().bindFramebuffer(GL_READ_FRAMEBUFFER, source);
+		renderState().bindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+		glBlitFramebuffer(0, 0, screenWidth, screenHeight, 0, 0, screenWidth, screenHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		renderState().bindFramebuffer(GL_FRAMEBUFFER, source);
+
+		shader.use();
+		renderState().bindTexture(HIZ_TEXTURE_UNIT, depth);
+		renderState().activeTexture(0);
+		int sourceWidth = screenWidth, sourceHeight = screenHeight;
+		for (int level = 0; level < levels; level++)
+		{
+			int levelWidth = std::max(width >> level, 1), levelHeight = std::max(height >> level, 1);
+			glBindImageTexture(0, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+			glBindImageTexture(1, pyramid, std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+			glUniform1i(fromDepthLocation, level == 0);
+			glUniform2i(sourceSizeLocation, sourceWidth, sourceHeight);
+			glDispatchCompute((levelWidth + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (levelHeight + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			sourceWidth = levelWidth;
+			sourceHeight = levelHeight;
+		}
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		this->viewProjection = viewProjection;
+		valid = true;
+	}
+
+	void destroy()
+	{
+		destroyTextures();
+		glDeleteFramebuffers(1, &framebuffer);
+		shader.destroy();
+	}
+
+private:
+	ComputeShader shader;
+	unsigned int framebuffer = 0;
+	int screenWidth = 0, screenHeight = 0;
+	int fromDepthLocation, sourceSizeLocation;
+
+	static int floorPowerOfTwo(int value)
+	{
+		int power = 1;
+		while (power * 2 <= value) power *= 2;
+		return power;
+	}
+
+	void resize(int screenWidth, int screenHeight)
+	{
+		if (screenWidth == this->screenWidth && screenHeight == this->screenHeight) return;
+		destroyTextures();
+		valid = false;
+		this->screenWidth = screenWidth;
+		this->screenHeight = screenHeight;
+		width = floorPowerOfTwo(std::max(screenWidth, 1));
+		height = floorPowerOfTwo(std::max(screenHeight, 1));
+		levels = 1;
+		while ((std::max(width, height) >> levels) > 0) levels++;
+
+		// the same format as the default framebuffer's and the G-buffer's depth, blits between depth buffers
+		// need matching formats
+		glGenTextures(1, &depth);
+		renderState().bindTexture(RENDERSTATE_SCRATCH_UNIT, depth);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, screenWidth, screenHeight, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		renderState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER::HIZ_INCOMPLETE" << std::endl;
+		renderState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		glGenTextures(1, &pyramid);
+		renderState().bindTexture(RENDERSTATE_SCRATCH_UNIT, pyramid);
+		glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	void destroyTextures()
+	{
+		unsigned int textures[] = { depth, pyramid };
+		if (depth || pyramid) renderState().deleteTextures(2, textures);
+		depth = pyramid = 0;
+	}
+};
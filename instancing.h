@@ -0,0 +1,51 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "buffer.h"
+#include "VertexArray.h"
+
+// everything a shader needs to place one copy of a mesh, streamed as vertex attributes
+struct InstanceData
+{
+	glm::mat4 model;
+	glm::mat3 normalMatrix;
+};
+
+class InstanceBuffer
+{
+public:
+	std::vector<InstanceData> instances;
+	VertexBuffer vb;
+
+	// attaches the per-instance attributes to the currently bound VertexArray:
+	// model matrix at firstLocation..firstLocation+3, normal matrix at firstLocation+4..firstLocation+6
+	InstanceBuffer(VertexArray& va, unsigned int firstLocation) : vb(NULL, 0, GL_DYNAMIC_DRAW)
+	{
+		va.bind();
+		vb.bind();
+		va.setInstancedMatrixAttribute(firstLocation, 4, 4, sizeof(InstanceData), offsetof(InstanceData, model));
+		va.setInstancedMatrixAttribute(firstLocation + 4, 3, 3, sizeof(InstanceData), offsetof(InstanceData, normalMatrix));
+	}
+
+	void upload()
+	{
+		vb.update(instances.data(), (unsigned int)(instances.size() * sizeof(InstanceData)));
+	}
+
+	// one draw call for every instance, indexed through the ElementBuffer bound to the VertexArray
+	void draw(int indexCount)
+	{
+		glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)0, (GLsizei)instances.size());
+	}
+
+	// one draw call per instance, for comparing against the instanced path. base instance picks the
+	// attributes so both paths run the exact same shader
+	void drawEach(int indexCount)
+	{
+		for (unsigned int i = 0; i < instances.size(); i++)
+			glDrawElementsInstancedBaseInstance(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)0, 1, i);
+	}
+};
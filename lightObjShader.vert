@@ -1,11 +1,10 @@
 #version 460 core
 layout (location = 0) in vec3 aPos;
+layout (location = 3) in mat4 aModel; // per instance, locations 3-6
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "frameData.glsl"
 
 void main()
 {
-   gl_Position = projection * view * model * vec4(aPos, 1.0);
+   gl_Position = projection * view * aModel * vec4(aPos, 1.0);
 };
\ No newline at end of file
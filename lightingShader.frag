@@ -1,51 +1,25 @@
 #version 460 core
 
-struct DirLight
-{
-	vec3 direction;
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-};
-uniform DirLight dirLight;
+#include "frameData.glsl"
+#include "lights.glsl"
+#include "material.glsl"
+
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
-struct PointLight
+// clustered point lights, binned on the CPU every frame (see cluster.h, the grid size must match)
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+layout (std430, binding = 3) readonly buffer ClusterData
 {
-	vec3 position;
-	
-	float constant;
-	float linear;
-	float quadratic;
-
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
+	uvec2 clusters[]; // offset and count into clusterLightIndices
 };
-#define NR_POINT_LIGHTS 4
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-
-struct Material
+layout (std430, binding = 4) readonly buffer ClusterIndexData
 {
-	sampler2D diffuse;
-	sampler2D specular;
-	float shininess;
+	uint clusterLightIndices[];
 };
 
-//struct Light
-//{
-//	vec3 position;
-//
-//	vec3 ambient;
-//	vec3 diffuse;
-//	vec3 specular;
-//
-//	float constant;
-//	float linear;
-//	float quadratic;
-//};
-
 out vec4 FragColor;
 
 in vec3 Normal;
@@ -53,9 +27,6 @@ in vec3 FragPos;
 in vec2 TexCoords;
 
 uniform vec3 objectColor;
-uniform vec3 viewPos;
-uniform Material material;
-//uniform Light light;
 
 void main()
 {
@@ -65,12 +36,16 @@ void main()
 
     // phase 1: Directional lighting
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    // phase 2: Point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
-    // phase 3: Spot light
-    //result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
-    
+#ifdef POINT_LIGHTS
+    // phase 2: Point lights, only the ones binned into this fragment's cluster
+    float viewDepth = -(view * vec4(FragPos, 1.0)).z;
+    uint slice = uint(clamp(floor(log(viewDepth / zNear) * CLUSTER_Z / log(zFar / zNear)), 0.0, CLUSTER_Z - 1.0));
+    uvec2 tile = uvec2(clamp(gl_FragCoord.xy / screenSize * vec2(CLUSTER_X, CLUSTER_Y), vec2(0.0), vec2(CLUSTER_X - 1.0, CLUSTER_Y - 1.0)));
+    uvec2 cluster = clusters[tile.x + CLUSTER_X * (tile.y + CLUSTER_Y * slice)];
+    for(uint i = 0; i < cluster.y; i++)
+        result += CalcPointLight(pointLights[clusterLightIndices[cluster.x + i]], norm, FragPos, viewDir);
+#endif
+
     FragColor = vec4(result, 1.0);
 }
 
@@ -86,7 +61,7 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     // combine results
     vec3 ambient  = light.ambient  * vec3(texture(material.diffuse, TexCoords));
     vec3 diffuse  = light.diffuse  * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 specular = light.specular * spec * materialSpecular(TexCoords);
     return (ambient + diffuse + specular);
 } 
 
@@ -105,7 +80,7 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     // combine results
     vec3 ambient  = light.ambient  * vec3(texture(material.diffuse, TexCoords));
     vec3 diffuse  = light.diffuse  * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 specular = light.specular * spec * materialSpecular(TexCoords);
     ambient  *= attenuation;
     diffuse  *= attenuation;
     specular *= attenuation;
@@ -2,19 +2,43 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in mat4 aModel; // per instance, locations 3-6
+layout (location = 7) in mat3 aNormalMatrix; // per instance, locations 7-9
 
 out vec3 Normal;
 out vec3 FragPos;
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "frameData.glsl"
+
+#ifdef MULTI_DRAW
+// drawn by glMultiDrawElementsIndirect, the transforms come per draw instead of per instance (see multidraw.h)
+#include "drawData.glsl"
+layout (std430, binding = 5) readonly buffer DrawDataBlock
+{
+   DrawData draws[];
+};
+#endif
+
+// the depth pre-pass computes the same position in depthPrepass.vert and relies on getting the same bits
+invariant gl_Position;
 
 void main()
 {
+#ifdef MULTI_DRAW
+   mat4 model = draws[gl_DrawID].model;
+   mat3 normalMatrix = draws[gl_DrawID].normalMatrix;
+#else
+   mat4 model = aModel;
+   mat3 normalMatrix = aNormalMatrix;
+#endif
    FragPos = vec3(model * vec4(aPos, 1.0f));
+#ifdef GPU_NORMAL_MATRIX
+   // reference path: a full inverse per vertex, kept around to A/B against the CPU computed normal matrix
    Normal = mat3(transpose(inverse(model))) * aNormal;
+#else
+   Normal = normalMatrix * aNormal;
+#endif
 
    gl_Position = projection * view * model * vec4(aPos, 1.0);
 
@@ -0,0 +1,30 @@
+struct DirLight
+{
+	vec3 direction;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
+
+// attenuation terms are interleaved with the vec3s so std430 packs each light into 64 bytes (see uniformblocks.h)
+struct PointLight
+{
+	vec3 position;
+	float constant;
+	vec3 ambient;
+	float linear;
+	vec3 diffuse;
+	float quadratic;
+	vec3 specular;
+	float radius;
+};
+
+layout (std140, binding = 1) uniform LightData
+{
+	DirLight dirLight;
+};
+
+layout (std430, binding = 2) readonly buffer PointLightData
+{
+	PointLight pointLights[];
+};
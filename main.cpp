@@ -1,11 +1,38 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
 
 #include "shader.h"
+#include "shaderwatcher.h"
 #include "buffer.h"
 #include "VertexArray.h"
 #include "texture.h"
+#include "instancing.h"
+#include "normalmatrix.h"
+#include "mesh.h"
+#include "uniformblocks.h"
+#include "cluster.h"
+#include "framebuffer.h"
+#include "bvh.h"
+#include "profiler.h"
+#include "capture.h"
+#include "renderstate.h"
+#include "renderqueue.h"
+#include "multidraw.h"
+#include "gpuculling.h"
+#include "hiz.h"
+#include "occlusionbuffer.h"
+#include "assetpack.h"
+#include "simulation.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -23,6 +50,14 @@ void processInput(GLFWwindow* window); // for continous key press
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods); // single key presses, i.e toggles
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn);
+void runBVHBenchmark(size_t objectCount, float results[5]);
+void runMipBenchmark(int size, float results[6]);
+void runSortBenchmark(size_t count, float results[2]);
+void runACMRBenchmark(int gridSize, int cacheSize, float results[3]);
+int runOcclusionCheck();
+
+// the render queue's passes, executed in this order every frame
+enum RenderPass { PASS_DEPTH, PASS_SCENE, PASS_MARKERS };
 
 int resWidth = 800;
 int resHeight = 600;
@@ -38,13 +73,78 @@ bool mouseToggle = false;
 
 Camera camera;
 
-int main()
+int main(int argc, char** argv)
 {
+    auto startupBegin = std::chrono::high_resolution_clock::now();
+
+    // --bake <image> <output.dds> [bc1|bc3|bc4|bc5] [linear] compresses a texture with its mips and exits, no window
+    // needed. linear is for data maps like container2_specular, whose mips mustn't be filtered as sRGB
+    if (argc >= 4 && strcmp(argv[1], "--bake") == 0)
+    {
+        std::string format;
+        bool linear = false;
+        for (int i = 4; i < argc; i++)
+        {
+            if (strcmp(argv[i], "linear") == 0) linear = true;
+            else format = argv[i];
+        }
+        return bakeTexture(argv[2], argv[3], format, linear) ? 0 : -1;
+    }
+
+    // --pack <output.pack> <files...> bundles shaders and textures into one archive under the names they're loaded by
+    if (argc >= 4 && strcmp(argv[1], "--pack") == 0)
+        return writeAssetPack(argv[2], std::vector<std::string>(argv + 3, argv + argc)) ? 0 : -1;
+
+    // --headless <frames> [output dir] renders a fixed camera path into an offscreen target with a hidden window,
+    // writing every frame as a PNG and the frame timings as a CSV, then exits. --deferred picks the deferred path
+    bool headless = false;
+    int headlessFrames = 0;
+    std::string captureDir = ".";
+    bool startDeferred = false;
+    bool startGPUCulling = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+        {
+            headless = true;
+            headlessFrames = atoi(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] != '-') captureDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--deferred") == 0) startDeferred = true;
+        // starts in multi-draw mode with the compute culling on, headless runs check it against the CPU every frame
+        else if (strcmp(argv[i], "--gpu-culling") == 0) startGPUCulling = true;
+        // every program is compiled from source and nothing is written to the cache, for timing a cold start
+        else if (strcmp(argv[i], "--no-program-cache") == 0) programCache().enabled = false;
+    }
+
+    // everything in assets.pack is read from one mapping of it, anything missing from it (or all of it, without a
+    // pack) still comes from the loose files
+    bool packed = assetPack().open("assets.pack");
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    GLFWwindow* window = glfwCreateWindow(resWidth, resHeight, "LearnOpenGL", NULL, NULL);
+    GLFWwindow* window = NULL;
+    if (headless)
+    {
+        // a real offscreen context needs no display, try EGL then OSMesa before settling for a hidden window
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        const int offscreenAPIs[] = { GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API };
+        const char* offscreenNames[] = { "EGL", "OSMesa" };
+        for (int i = 0; i < 2 && window == NULL; i++)
+        {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, offscreenAPIs[i]);
+            window = glfwCreateWindow(resWidth, resHeight, "LearnOpenGL", NULL, NULL);
+            if (window != NULL) std::cout << "Headless: using an " << offscreenNames[i] << " context" << std::endl;
+        }
+        if (window == NULL)
+        {
+            std::cout << "Headless: no EGL or OSMesa context, falling back to a hidden window" << std::endl;
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+        }
+    }
+    if (window == NULL) window = glfwCreateWindow(resWidth, resHeight, "LearnOpenGL", NULL, NULL);
     if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -86,48 +186,70 @@ int main()
 
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    Shader lightingShader("lightingShader.vert", "lightingShader.frag");
+    auto shadersBegin = std::chrono::high_resolution_clock::now();
+    // the forward and geometry pass shaders come in variants picked by the Debug Menu toggles, built on first use
+    ShaderPermutations forwardShaders("lightingShader.vert", "lightingShader.frag");
+    ShaderPermutations gBufferShaders("lightingShader.vert", "gBuffer.frag");
+    ShaderPermutations depthShaders("depthPrepass.vert", "depthPrepass.frag");
     Shader lightObjShader("lightObjShader.vert", "lightObjShader.frag");
+    Shader deferredDirLightShader("deferredDirLight.vert", "deferredDirLight.frag");
+    Shader deferredPointLightShader("deferredPointLight.vert", "deferredPointLight.frag");
+    float shaderMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - shadersBegin).count();
+
+    // weld the 36 vertex cube into 24 unique vertices and order the triangles for the post-transform cache
+    const int vertexCacheSize = 16;
+    Mesh cubeMesh = weldVertices(vertices, sizeof(vertices) / sizeof(float), 8);
+    orientTriangles(cubeMesh, 3); // vertices.h mixes windings, the light volumes rely on culling
+    float weldedACMR = computeACMR(cubeMesh.indices, vertexCacheSize);
+    optimizeVertexCache(cubeMesh.indices, cubeMesh.vertexCount(), vertexCacheSize);
+    float optimizedACMR = computeACMR(cubeMesh.indices, vertexCacheSize);
+    int cubeIndexCount = (int)cubeMesh.indices.size();
+
+    // every static mesh goes into the one arena so every VAO below can draw any of them, the cube is the first
+    MeshArena meshArena(8);
+    unsigned int cubeMeshID = meshArena.add(cubeMesh);
 
     VertexArray va;
-    VertexBuffer vb(vertices, sizeof(vertices));
+    VertexBuffer vb(meshArena.vertices.data(), (unsigned int)(meshArena.vertices.size() * sizeof(float)));
+    ElementBuffer eb(meshArena.indices.data(), (unsigned int)(meshArena.indices.size() * sizeof(unsigned int)));
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
     glEnableVertexAttribArray(2);
+    InstanceBuffer cubeInstances(va, 3);
     va.unbind();
 
     VertexArray lightVAO;
+    vb.bind();
+    eb.bind();
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
+    InstanceBuffer lightInstances(lightVAO, 3);
     lightVAO.unbind();
 
-    lightingShader.use();
-
-    Texture diffuseTexture("container2.png", 0);
-    diffuseTexture.SetSampler2D(lightingShader.ID, "material.diffuse");
-
-    Texture specularMap("container2_specular.png", 1);
-    specularMap.SetSampler2D(lightingShader.ID, "material.specular");
-
-    lightingShader.setVec3("lightColor", 0.0f, 0.7f, 0.0f);
-
-    lightingShader.setVec3("material.ambient", 1.0f, 0.5f, 0.31f);
-    lightingShader.setVec3("material.diffuse", 1.0f, 0.5f, 0.31f);
-    lightingShader.setVec3("material.specular", 0.5f, 0.5f, 0.5f);
-    lightingShader.setFloat("material.shininess", 32.0f);
-
-    lightingShader.setVec3("dirlight.ambient", 0.2f, 0.2f, 0.2f);
-    lightingShader.setVec3("dirlight.diffuse", 0.5f, 0.5f, 0.5f); // darken diffuse light a bit
-    lightingShader.setVec3("dirlight.specular", 1.0f, 1.0f, 1.0f);
-    lightingShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-
+    // deferred light volumes only need positions, each instance is placed by its light in the shader
+    VertexArray volumeVAO;
+    vb.bind();
+    eb.bind();
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    volumeVAO.unbind();
 
-    glm::vec3 lightPos = glm::vec3(1.2f, 1.0f, 1.0f);
-    lightingShader.setVec3("lightPos", lightPos);
+    // the full screen pass generates its vertices from gl_VertexID but core profile still wants a VAO bound
+    VertexArray emptyVAO;
+    emptyVAO.unbind();
 
+    GBuffer gBuffer(resWidth, resHeight);
+    Profiler profiler;
+    FrameCapture capture;
+    if (headless)
+    {
+        capture.create(resWidth, resHeight);
+        gBuffer.output = capture.ID;
+        profiler.keepTimings = true;
+    }
 
     glm::vec3 pointLightPositions[] = {
         glm::vec3(0.7f,  0.2f,  2.0f),
@@ -136,38 +258,101 @@ int main()
         glm::vec3(0.0f,  0.0f, -3.0f)
     };
 
-    lightingShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-    lightingShader.setFloat("pointLights[0].constant", 1.0f);
-    lightingShader.setFloat("pointLights[0].linear", 0.09f);
-    lightingShader.setFloat("pointLights[0].quadratic", 0.032f);
-    lightingShader.setVec3("pointLights[0].ambient", 0.2f, 0.2f, 0.2f);
-    lightingShader.setVec3("pointLights[0].diffuse", 0.5f, 0.5f, 0.5f); // darken diffuse light a bit
-    lightingShader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-
-    lightingShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-    lightingShader.setFloat("pointLights[1].constant", 1.0f);
-    lightingShader.setFloat("pointLights[1].linear", 0.09f);
-    lightingShader.setFloat("pointLights[1].quadratic", 0.032f);
-    lightingShader.setVec3("pointLights[1].ambient", 0.2f, 0.2f, 0.2f);
-    lightingShader.setVec3("pointLights[1].diffuse", 0.5f, 0.5f, 0.5f); // darken diffuse light a bit
-    lightingShader.setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-
-    lightingShader.setVec3("pointLights[2].position", pointLightPositions[2]);
-    lightingShader.setFloat("pointLights[2].constant", 1.0f);
-    lightingShader.setFloat("pointLights[2].linear", 0.09f);
-    lightingShader.setFloat("pointLights[2].quadratic", 0.032f);
-    lightingShader.setVec3("pointLights[2].ambient", 0.2f, 0.2f, 0.2f);
-    lightingShader.setVec3("pointLights[2].diffuse", 0.5f, 0.5f, 0.5f); // darken diffuse light a bit
-    lightingShader.setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-
-    lightingShader.setVec3("pointLights[3].position", pointLightPositions[3]);
-    lightingShader.setFloat("pointLights[3].constant", 1.0f);
-    lightingShader.setFloat("pointLights[3].linear", 0.09f);
-    lightingShader.setFloat("pointLights[3].quadratic", 0.032f);
-    lightingShader.setVec3("pointLights[3].ambient", 0.2f, 0.2f, 0.2f);
-    lightingShader.setVec3("pointLights[3].diffuse", 0.5f, 0.5f, 0.5f); // darken diffuse light a bit
-    lightingShader.setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
+    // light data every lighting program reads from the LightData block
+    LightUniforms lights = {};
+    lights.dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    lights.dirLight.ambient = glm::vec3(0.2f, 0.2f, 0.2f);
+    lights.dirLight.diffuse = glm::vec3(0.5f, 0.5f, 0.5f); // darken diffuse light a bit
+    lights.dirLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+
+    // the 4 hand placed point lights come first, the rest are small coloured lights for stress testing the clustering
+    const int maxPointLights = 10000;
+    std::vector<PointLightData> pointLights(maxPointLights);
+    std::mt19937 lightRng(4242);
+    std::uniform_real_distribution<float> lightScatter(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> lightColor(0.2f, 1.0f);
+    for (int i = 0; i < maxPointLights; i++)
+    {
+        PointLightData& light = pointLights[i];
+        if (i < 4)
+        {
+            light.position = pointLightPositions[i];
+            light.constant = 1.0f;
+            light.linear = 0.09f;
+            light.quadratic = 0.032f;
+            light.ambient = glm::vec3(0.2f, 0.2f, 0.2f);
+            light.diffuse = glm::vec3(0.5f, 0.5f, 0.5f); // darken diffuse light a bit
+            light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        }
+        else
+        {
+            light.position = glm::vec3(lightScatter(lightRng), lightScatter(lightRng), lightScatter(lightRng) - 50.0f);
+            light.constant = 1.0f;
+            light.linear = 1.0f;
+            light.quadratic = 10.0f;
+            light.ambient = glm::vec3(0.0f);
+            light.diffuse = glm::vec3(lightColor(lightRng), lightColor(lightRng), lightColor(lightRng));
+            light.specular = light.diffuse;
+        }
+        light.radius = pointLightRadius(light);
+    }
+
+    UniformBuffer frameUBO(sizeof(FrameUniforms), FRAME_BLOCK_BINDING);
+    UniformBuffer lightUBO(sizeof(LightUniforms), LIGHT_BLOCK_BINDING);
+    ShaderStorageBuffer pointLightSSBO(maxPointLights * sizeof(PointLightData), POINT_LIGHT_STORAGE_BINDING);
+    ShaderStorageBuffer clusterSSBO(CLUSTER_COUNT * sizeof(glm::uvec2), CLUSTER_STORAGE_BINDING);
+    ShaderStorageBuffer clusterIndexSSBO(CLUSTER_COUNT * 16 * sizeof(unsigned int), CLUSTER_INDEX_STORAGE_BINDING);
+
+    ThreadPool threadPool;
+    LightClusters lightClusters;
+
+    // decoded on the pool, the cubes show a grey placeholder for the first frames until the images are in.
+    // both are baked from the .png files next to them with --bake, the specular map with linear since it holds data
+    TextureLoader textureLoader(threadPool);
+    Texture diffuseTexture = textureLoader.load("container2.dds", 0);
+    Texture specularMap = textureLoader.load("container2_specular.dds", 1, false);
+
+    // the constant uniforms of every lit shader. setting one a shader doesn't have is a no-op, so this covers the
+    // forward, geometry and lighting passes alike. runs again whenever the watcher swaps in a rebuilt program
+    auto setupShader = [&](Shader& shader)
+    {
+        shader.use();
+        diffuseTexture.SetSampler2D(shader.ID, "material.diffuse");
+        specularMap.SetSampler2D(shader.ID, "material.specular");
+
+        shader.setVec3("lightColor", 0.0f, 0.7f, 0.0f);
 
+        shader.setVec3("material.ambient", 1.0f, 0.5f, 0.31f);
+        shader.setVec3("material.diffuse", 1.0f, 0.5f, 0.31f);
+        shader.setVec3("material.specular", 0.5f, 0.5f, 0.5f);
+        shader.setFloat("material.shininess", 32.0f);
+        shader.setFloat("shininess", 32.0f);
+    };
+
+    // saving any of the shader files, includes too, rebuilds the programs using it while the app runs
+    ShaderWatcher shaderWatcher;
+    shaderWatcher.onReload = setupShader;
+    for (Shader* shader : { &lightObjShader, &deferredDirLightShader, &deferredPointLightShader })
+    {
+        setupShader(*shader);
+        shaderWatcher.watch(*shader);
+    }
+    for (ShaderPermutations* permutations : { &forwardShaders, &gBufferShaders })
+    {
+        permutations->onCreate = [&](Shader& shader)
+        {
+            setupShader(shader);
+            shaderWatcher.watch(shader);
+        };
+    }
+    // no samplers or light blocks to set up, it only reads FrameData
+    depthShaders.onCreate = [&](Shader& shader) { shaderWatcher.watch(shader); };
+    // the variants the default settings draw with are built up front, the rest when they're first toggled on
+    shadersBegin = std::chrono::high_resolution_clock::now();
+    forwardShaders.get({ "SPECULAR_MAP", "POINT_LIGHTS" });
+    gBufferShaders.get({ "SPECULAR_MAP" });
+    depthShaders.get({});
+    shaderMs += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - shadersBegin).count();
 
     glm::vec3 cubePositions[] = {
         glm::vec3(0.0f,  0.0f,  0.0f),
@@ -182,20 +367,100 @@ int main()
         glm::vec3(-1.3f,  1.0f, -1.5f)
     };
 
+    // the hand placed cubes come first, the rest are scattered around them for stress testing
+    const int maxCubes = 200000;
+    std::vector<glm::vec3> cubeField(cubePositions, cubePositions + 10);
+    std::mt19937 rng(1337);
+    std::uniform_real_distribution<float> scatter(-60.0f, 60.0f);
+    while (cubeField.size() < maxCubes)
+        cubeField.push_back(glm::vec3(scatter(rng), scatter(rng), scatter(rng) - 50.0f));
+
+    // per frame scratch space for transforms, world bounds and what survives culling
+    std::vector<glm::mat4> cubeModels, lightMarkerModels;
+    BoundsList cubeBounds, lightMarkerBounds;
+    std::vector<unsigned int> visibleCubes, visibleLightMarkers;
+    std::vector<SortEntry> instanceOrder, instanceSortScratch;
+    RenderQueue renderQueue;
+    MultiDrawBatch cubeBatch;
+    GPUCuller gpuCuller;
+    HiZBuffer hiZBuffer;
+    OcclusionBuffer occlusionBuffer;
+    std::vector<SortEntry> occluderOrder;
+    BVH cubeBVH;
+    std::vector<unsigned int> litCubes;
+
     // IMGUI Cube Model Controls
-    float rotationdeg = 45.0f;
     glm::vec3 modelAxis = glm::vec3(0.0f, 1.0f, 0.0f);
-    float spinSpeed = 0.5f;
-    bool spin = false;
-
-    glEnable(GL_DEPTH_TEST);
-    while (!glfwWindowShouldClose(window))
+    SimulationInput simulationInput; // the spin toggle and speed
+    FixedTimestep simulation;
+    bool interpolateSimulation = true;
+    int cubeCount = 10;
+    int drawMode = startGPUCulling ? 2 : 0;
+    const char* drawModes[] = { "Instanced", "Draw per object", "Multi-draw indirect" };
+    bool cpuNormals = true;
+    bool specularMapping = true;
+    bool pointLighting = true;
+    int pointLightCount = 4;
+    int uploadedPointLights = 0;
+    const float zNear = 0.1f;
+    const float zFar = 100.0f;
+    int renderMode = startDeferred ? 1 : 0;
+    bool frustumCulling = true;
+    bool gpuCulling = startGPUCulling;
+    unsigned int gpuCullingMismatches = 0;
+    bool hiZOcclusion = true;
+    bool softwareOcclusion = false;
+    bool depthPrepass = false;
+    bool baselineUniforms = false;
+    float baselineUniformMs = 0.0f;
+    SampleCounter shadedSamples;
+    int occluderCount = 32;
+    bool bvhCulling = false;
+    bool bvhRefit = true;
+    bool bvhQueries = false;
+    int bvhBuiltCount = 0;
+    float bvhBenchmark[5] = {};
+    float mipBenchmark[6] = {};
+    float sortBenchmark[2] = {};
+    float acmrBenchmark[3] = {};
+    int occlusionCheckFailures = -1;
+    bool frontToBack = true;
+    const char* renderModes[] = { "Forward (clustered)", "Deferred" };
+
+    // captured frames have to match from run to run, so headless runs don't start on placeholders
+    if (headless) textureLoader.finish();
+    float startupMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startupBegin).count();
+
+    renderState().enable(GL_DEPTH_TEST);
+    // last frame's GL state calls, the ones the render state cache let through and the ones it dropped
+    unsigned int stateCallsIssued = 0, stateCallsSkipped = 0;
+    int frameNumber = 0;
+    while (!glfwWindowShouldClose(window) && !(headless && frameNumber >= headlessFrames))
     {
-        processInput(window);
+        profiler.beginFrame();
+
+        if (headless)
+        {
+            // one orbit around the hand placed cubes every 240 frames, nothing depends on the clock or input so
+            // every run renders the same images
+            deltaTime = 1.0f / 60.0f;
+            float angle = glm::radians(frameNumber * 360.0f / 240.0f);
+            camera.cameraPos = glm::vec3(std::sin(angle) * 8.0f, 2.0f, -3.0f + std::cos(angle) * 8.0f);
+            camera.cameraFront = glm::normalize(glm::vec3(0.0f, 0.0f, -3.0f) - camera.cameraPos);
+            capture.bind();
+        }
+        else
+        {
+            processInput(window);
+            float currentFrame = glfwGetTime();
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+        }
 
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        // the animation moves in fixed ticks, not per frame, so it runs at the same speed at any frame rate. headless
+        // frames are exactly one tick long, which keeps the captures the same from run to run
+        simulation.advance(headless ? simulation.tickLength : deltaTime, simulationInput);
+        SimulationState simulationState = interpolateSimulation ? simulation.interpolated() : simulation.latest();
 
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -205,64 +470,473 @@ int main()
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
+        stateCallsIssued = renderState().issued;
+        stateCallsSkipped = renderState().skipped;
+        renderState().resetCounters();
 
-        lightingShader.use();
+        shaderWatcher.update();
 
-        glm::mat4 model = glm::mat4(1.0f);
-        //model = glm::rotate(model, glm::radians(rotationdeg), glm::vec3(modelAxis.x, modelAxis.y, modelAxis.z));
-        //lightingShader.setMat4("model", model);
-
-        glm::mat4 view = camera.getViewMatrix(); 
-        lightingShader.setMat4("view", view);
-        lightingShader.setVec3("viewPos", camera.cameraPos);
-
-        glm::mat4 projection = glm::perspective(glm::radians(camera.fov), (float)resWidth / float(resHeight), 0.1f, 100.0f);
-        lightingShader.setMat4("projection", projection);
+        // the shader variants for this frame's settings, built here the first time a combination is used
+        std::vector<std::string> forwardDefines, gBufferDefines, depthDefines;
+        if (!cpuNormals) forwardDefines.push_back("GPU_NORMAL_MATRIX");
+        if (pointLighting) forwardDefines.push_back("POINT_LIGHTS");
+        if (drawMode == 2)
+        {
+            forwardDefines.push_back("MULTI_DRAW");
+            gBufferDefines.push_back("MULTI_DRAW");
+            depthDefines.push_back("MULTI_DRAW");
+        }
+        if (specularMapping)
+        {
+            forwardDefines.push_back("SPECULAR_MAP");
+            gBufferDefines.push_back("SPECULAR_MAP");
+        }
+        Shader& cubeShader = forwardShaders.get(forwardDefines);
+        Shader& gBufferShader = gBufferShaders.get(gBufferDefines);
+        Shader& depthShader = depthShaders.get(depthDefines);
+
+        // counted from here on, a variant built just above made its link time queries already
+        cubeShader.uniformWrites = lightObjShader.uniformWrites = 0;
+        cubeShader.locationQueries = lightObjShader.locationQueries = 0;
+
+        int textureScope = profiler.begin("Texture Upload");
+        textureLoader.update(2.0f);
+        profiler.end(textureScope);
+
+        // camera and lights go up once per frame, every program reads them through the block bindings
+        int uploadScope = profiler.begin("Uniform Upload");
+        FrameUniforms frame;
+        frame.view = camera.getViewMatrix();
+        float aspect = (float)resWidth / float(resHeight);
+        frame.projection = camera.getProjectionMatrix(aspect, zNear, zFar);
+        frame.viewPos = camera.cameraPos;
+        frame.zNear = zNear;
+        frame.screenSize = glm::vec2((float)resWidth, (float)resHeight);
+        frame.zFar = zFar;
+        frameUBO.update(&frame, sizeof(frame));
+        lightUBO.update(&lights, sizeof(lights));
+
+        // the lights themselves only change with the slider, the cluster lists change with the camera
+        if (uploadedPointLights != pointLightCount)
+        {
+            pointLightSSBO.update(pointLights.data(), pointLightCount * sizeof(PointLightData));
+            lightMarkerModels.resize(pointLightCount);
+            lightMarkerBounds.resize(pointLightCount);
+            for (int i = 0; i < pointLightCount; i++)
+            {
+                glm::mat4 model = glm::mat4(1.0f);
+                model = glm::translate(model, pointLights[i].position);
+                model = glm::scale(model, glm::vec3(i < 4 ? 0.2f : 0.05f));
+                lightMarkerModels[i] = model;
+                lightMarkerBounds.setTransformed(i, model, glm::vec3(0.0f), glm::vec3(0.5f));
+            }
+            uploadedPointLights = pointLightCount;
+        }
+        profiler.end(uploadScope);
+        bool deferred = renderMode == 1;
 
-        va.bind();
+        // the deferred path shades lights through their volumes, and without POINT_LIGHTS the forward shader skips them
+        // too, so neither reads the cluster lists
+        float clusterMs = 0.0f;
+        if (!deferred && pointLighting)
+        {
+            ProfileScope binningScope(profiler, "Light Binning");
+            auto clusterStart = std::chrono::high_resolution_clock::now();
+            lightClusters.build(pointLights.data(), pointLightCount, frame.view, frame.projection, zNear, zFar, threadPool);
+            clusterMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - clusterStart).count();
+            clusterSSBO.update(lightClusters.clusters.data(), (unsigned int)(lightClusters.clusters.size() * sizeof(glm::uvec2)));
+            clusterIndexSSBO.update(lightClusters.lightIndices.data(), (unsigned int)(lightClusters.lightIndices.size() * sizeof(unsigned int)));
+        }
 
-        for (unsigned int i = 0; i < 10; i++)
+        int transformScope = profiler.begin("Cube Transforms");
+        cubeModels.resize(cubeCount);
+        cubeBounds.resize(cubeCount);
+        for (int i = 0; i < cubeCount; i++)
         {
             glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
+            model = glm::translate(model, cubeField[i]);
             float angle = 20.0f * i;
             model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            model = glm::rotate(model, glm::radians(rotationdeg), glm::vec3(modelAxis.x, modelAxis.y, modelAxis.z));
-            lightingShader.setMat4("model", model);
+            model = glm::rotate(model, glm::radians(simulationState.rotation), glm::vec3(modelAxis.x, modelAxis.y, modelAxis.z));
+            cubeModels[i] = model;
+            cubeBounds.setTransformed(i, model, glm::vec3(0.0f), glm::vec3(0.5f));
+        }
+        profiler.end(transformScope);
+
+        // only cull against the tree or run the queries below when asked to, a tree over every cube isn't free.
+        // the cubes only spin in place, so refitting keeps the tree usable until the count changes
+        bool cullOnGPU = frustumCulling && gpuCulling && drawMode == 2;
+        bool bvhCull = frustumCulling && bvhCulling && !cullOnGPU;
+        int bvhScope = profiler.begin("BVH");
+        float bvhMs = 0.0f;
+        if (bvhCull || bvhQueries)
+        {
+            auto bvhStart = std::chrono::high_resolution_clock::now();
+            if (!bvhRefit || bvhBuiltCount != cubeCount)
+            {
+                cubeBVH.build(cubeBounds);
+                bvhBuiltCount = cubeCount;
+            }
+            else cubeBVH.refit(cubeBounds);
+            bvhMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - bvhStart).count();
+        }
 
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        // pick whatever is under the crosshair, or under the cursor while the mouse is released
+        float pickDistance = 0.0f;
+        int pickedCube = -1;
+        litCubes.clear();
+        if (bvhQueries)
+        {
+            float pickNdcX = 0.0f, pickNdcY = 0.0f;
+            if (mouseToggle)
+            {
+                double cursorX, cursorY;
+                glfwGetCursorPos(window, &cursorX, &cursorY);
+                pickNdcX = (float)(2.0 * cursorX / resWidth - 1.0);
+                pickNdcY = (float)(1.0 - 2.0 * cursorY / resHeight);
+            }
+            pickedCube = cubeBVH.raycast(camera.cameraPos, camera.getRayDirection(pickNdcX, pickNdcY, aspect), cubeBounds, pickDistance);
+            cubeBVH.querySphere(pointLights[0].position, pointLights[0].radius, cubeBounds, litCubes);
+        }
+        profiler.end(bvhScope);
+
+        // only what the camera can see becomes an instance. with GPU culling every cube goes to the compute pass,
+        // which decides what gets drawn
+        int cullScope = profiler.begin("Culling");
+        visibleCubes.clear();
+        visibleLightMarkers.clear();
+        Frustum frustum = camera.getFrustum(aspect, zNear, zFar);
+        if (frustumCulling)
+        {
+            if (cullOnGPU) for (int i = 0; i < cubeCount; i++) visibleCubes.push_back(i);
+            else if (bvhCull) cubeBVH.cullFrustum(frustum, cubeBounds, visibleCubes);
+            else cullBounds(frustum, cubeBounds, visibleCubes);
+            cullBounds(frustum, lightMarkerBounds, visibleLightMarkers);
+        }
+        else
+        {
+            for (int i = 0; i < cubeCount; i++) visibleCubes.push_back(i);
+            for (int i = 0; i < pointLightCount; i++) visibleLightMarkers.push_back(i);
         }
-        va.unbind();
+        profiler.end(cullScope);
 
-        lightObjShader.use();
-        
+        // the nearest visible cubes are rasterized into a small depth buffer on the CPU and every visible cube
+        // behind them is dropped. GPU culling does the same against the Hi-Z pyramid instead
+        size_t softwareOccluded = 0;
+        float occlusionMs = 0.0f;
+        if (softwareOcclusion && !cullOnGPU)
+        {
+            ProfileScope occlusionScope(profiler, "Software Occlusion");
+            auto occlusionStart = std::chrono::high_resolution_clock::now();
+            occluderOrder.clear();
+            for (unsigned int cube : visibleCubes)
+                occluderOrder.push_back({ depthBits(-(frame.view * glm::vec4(cubeField[cube], 1.0f)).z), cube });
+            size_t occluders = std::min(occluderOrder.size(), (size_t)occluderCount);
+            std::partial_sort(occluderOrder.begin(), occluderOrder.begin() + occluders, occluderOrder.end(),
+                [](const SortEntry& a, const SortEntry& b) { return a.key < b.key; });
+            occlusionBuffer.clear(frame.projection * frame.view, zNear);
+            for (size_t i = 0; i < occluders; i++) occlusionBuffer.drawBox(cubeModels[occluderOrder[i].index]);
+            occlusionBuffer.finish();
+
+            size_t kept = 0;
+            for (unsigned int cube : visibleCubes)
+            {
+                glm::vec3 center(cubeBounds.centerX[cube], cubeBounds.centerY[cube], cubeBounds.centerZ[cube]);
+                glm::vec3 extent(cubeBounds.extentX[cube], cubeBounds.extentY[cube], cubeBounds.extentZ[cube]);
+                if (!occlusionBuffer.isOccluded(center, extent)) visibleCubes[kept++] = cube;
+            }
+            softwareOccluded = visibleCubes.size() - kept;
+            visibleCubes.resize(kept);
+            occlusionMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - occlusionStart).count();
+        }
 
-        view = camera.getViewMatrix();
-        lightObjShader.setMat4("view", view);
+        int instanceScope = profiler.begin("Instance Upload");
+        // sorted near to far, so one instanced draw still rasterizes the closest cubes first and early Z throws away
+        // what they hide. GPU culling takes the transforms straight from cubeModels, its compaction loses any order
+        // and its compute pass builds the normal matrices of the survivors
+        instanceOrder.clear();
+        if (!cullOnGPU)
+        {
+            for (unsigned int cube : visibleCubes)
+                instanceOrder.push_back({ depthBits(-(frame.view * glm::vec4(cubeField[cube], 1.0f)).z), cube });
+            if (frontToBack) radixSort(instanceOrder, instanceSortScratch);
+        }
+        cubeInstances.instances.resize(instanceOrder.size());
+        for (size_t i = 0; i < instanceOrder.size(); i++)
+            cubeInstances.instances[i].model = cubeModels[instanceOrder[i].index];
+        if (cpuNormals || deferred) computeNormalMatrices(cubeInstances.instances.data(), cubeInstances.instances.size());
+        // the multi-draw path writes the transforms into its own batch below instead
+        if (drawMode != 2) cubeInstances.upload();
+
+        lightInstances.instances.resize(visibleLightMarkers.size());
+        for (size_t i = 0; i < visibleLightMarkers.size(); i++)
+            lightInstances.instances[i] = { lightMarkerModels[visibleLightMarkers[i]], glm::mat3(1.0f) };
+        lightInstances.upload();
+        profiler.end(instanceScope);
+
+        // every scene draw goes through the queue: the cubes in PASS_SCENE (forward, or the deferred geometry pass),
+        // the light markers in PASS_MARKERS after the lighting. one instanced draw each, or a draw per instance without
+        // instancing, which is where sorting by state and then depth pays off. multi-draw turns every cube into an
+        // indirect command of one batch, so it's a draw per object again but in a single call. with the depth
+        // pre-pass on the cube draws go into PASS_DEPTH a second time with the position only program
+        int queueScope = profiler.begin("Render Queue");
+        renderQueue.clear();
+        Shader& sceneShader = deferred ? gBufferShader : cubeShader;
+        DrawCommand cubeDraw;
+        cubeDraw.program = sceneShader.ID;
+        cubeDraw.vertexArray = va.ID;
+        cubeDraw.diffuse = diffuseTexture.ID;
+        cubeDraw.specular = specularMap.ID;
+        cubeDraw.indexCount = cubeIndexCount;
+        cubeDraw.instanceCount = (unsigned int)cubeInstances.instances.size();
+        DrawCommand markerDraw;
+        markerDraw.program = lightObjShader.ID;
+        markerDraw.vertexArray = lightVAO.ID;
+        markerDraw.indexCount = cubeIndexCount;
+        markerDraw.instanceCount = (unsigned int)lightInstances.instances.size();
+        if (cullOnGPU)
+        {
+            ProfileScope gpuCullScope(profiler, "GPU Culling");
+            // every cube draws the same mesh, so the objects only go up again when the count changes
+            if (gpuCuller.objects.size() != (size_t)cubeCount)
+            {
+                const MeshRange& mesh = meshArena.meshes[cubeMeshID];
+                CullObject object;
+                object.indexCount = mesh.indexCount;
+                object.firstIndex = mesh.firstIndex;
+                object.baseVertex = mesh.baseVertex;
+                object.padding = 0;
+                gpuCuller.objects.assign(cubeCount, object);
+                gpuCuller.uploadObjects();
+            }
+            gpuCuller.transforms.resize(cubeCount);
+            for (int i = 0; i < cubeCount; i++)
+            {
+                CullTransform& transform = gpuCuller.transforms[i];
+                transform.model = cubeModels[i];
+                transform.center = glm::vec4(cubeBounds.centerX[i], cubeBounds.centerY[i], cubeBounds.centerZ[i], 0.0f);
+                transform.extent = glm::vec4(cubeBounds.extentX[i], cubeBounds.extentY[i], cubeBounds.extentZ[i], 0.0f);
+            }
+            gpuCuller.cull(frustum, hiZOcclusion ? &hiZBuffer : NULL);
+            gpuCuller.fillDraw(cubeDraw);
+        }
+        else if (drawMode == 2)
+        {
+            cubeBatch.begin((unsigned int)cubeInstances.instances.size());
+            for (const InstanceData& instance : cubeInstances.instances)
+                cubeBatch.add(meshArena.meshes[cubeMeshID], instance.model, instance.normalMatrix);
+            cubeDraw.indirectBuffer = cubeBatch.commands.ID;
+            cubeDraw.indirectOffset = cubeBatch.commandOffset();
+            cubeDraw.drawCount = cubeBatch.drawCount;
+        }
+        DrawCommand depthDraw = cubeDraw;
+        depthDraw.program = depthShader.ID;
+        depthDraw.diffuse = depthDraw.specular = 0;
+        if (drawMode != 1)
+        {
+            if (depthPrepass) renderQueue.submit(RenderQueue::opaqueKey(PASS_DEPTH, depthDraw.program, 0, 0), depthDraw);
+            renderQueue.submit(RenderQueue::opaqueKey(PASS_SCENE, cubeDraw.program, 0, 0), cubeDraw);
+            renderQueue.submit(RenderQueue::opaqueKey(PASS_MARKERS, markerDraw.program, 0, 0), markerDraw);
+        }
+        else
+        {
+            for (unsigned int i = 0; i < cubeDraw.instanceCount; i++)
+            {
+                DrawCommand draw = cubeDraw;
+                draw.firstInstance = i;
+                draw.instanceCount = 1;
+                renderQueue.submit(RenderQueue::opaqueKey(PASS_SCENE, draw.program, 0, (uint32_t)instanceOrder[i].key), draw);
+                if (!depthPrepass) continue;
+                draw.program = depthDraw.program;
+                draw.diffuse = draw.specular = 0;
+                renderQueue.submit(RenderQueue::opaqueKey(PASS_DEPTH, draw.program, 0, (uint32_t)instanceOrder[i].key), draw);
+            }
+            for (unsigned int i = 0; i < markerDraw.instanceCount; i++)
+            {
+                DrawCommand draw = markerDraw;
+                draw.firstInstance = i;
+                draw.instanceCount = 1;
+                renderQueue.submit(RenderQueue::opaqueKey(PASS_MARKERS, draw.program, 0, 0), draw);
+            }
+        }
+        if (frontToBack) renderQueue.sort();
+        profiler.end(queueScope);
+
+        // the cubes, into whatever is bound. with the pre-pass their depth is laid down first without any shading, and
+        // the shading pass then only runs the fragment shader where its depth is exactly the closest one, so every
+        // pixel is shaded once however the cubes overlap. it pays when shading costs more than drawing the geometry
+        // twice, which is the forward shader with many point lights more than the geometry pass
+        auto drawScene = [&]()
+        {
+            if (depthPrepass)
+            {
+                ProfileScope depthScope(profiler, "Depth Pre-Pass");
+                renderState().colorMask(false);
+                renderQueue.execute(PASS_DEPTH);
+                renderState().colorMask(true);
+                renderState().depthFunc(GL_EQUAL);
+                renderState().depthMask(false);
+            }
+            shadedSamples.begin();
+            renderQueue.execute(PASS_SCENE);
+            shadedSamples.end();
+            renderState().depthFunc(GL_LESS);
+            renderState().depthMask(true);
+        };
+
+        if (deferred)
+        {
+            // geometry pass: material and surface data only, no lighting
+            int geometryScope = profiler.begin("Geometry Pass");
+            gBuffer.resize(resWidth, resHeight);
+            gBuffer.bind();
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            drawScene();
+            gBuffer.unbind();
+            profiler.end(geometryScope);
+
+            // lighting passes: the directional light once per pixel, then every point light's volume added on top.
+            // only back faces of the volumes are drawn, without depth testing, so a camera inside one still gets lit
+            int lightingScope = profiler.begin("Lighting Passes");
+            gBuffer.bindTextures(2);
+            renderState().disable(GL_DEPTH_TEST);
+            deferredDirLightShader.use();
+            emptyVAO.bind();
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            renderState().enable(GL_BLEND);
+            renderState().blendFunc(GL_ONE, GL_ONE);
+            renderState().enable(GL_CULL_FACE);
+            renderState().cullFace(GL_FRONT);
+            if (pointLighting)
+            {
+                deferredPointLightShader.use();
+                volumeVAO.bind();
+                glDrawElementsInstanced(GL_TRIANGLES, cubeIndexCount, GL_UNSIGNED_INT, (void*)0, pointLightCount);
+            }
+            renderState().cullFace(GL_BACK);
+            renderState().disable(GL_CULL_FACE);
+            renderState().disable(GL_BLEND);
+            renderState().enable(GL_DEPTH_TEST);
+            profiler.end(lightingScope);
+
+            // the light markers are still drawn forward, against the scene's depth
+            gBuffer.blitDepthToOutput();
+        }
+        else
+        {
+            ProfileScope forwardScope(profiler, "Forward Pass");
+            drawScene();
+        }
 
-        projection = glm::perspective(glm::radians(camera.fov), (float)resWidth / float(resHeight), 0.1f, 100.0f);
-        lightObjShader.setMat4("projection", projection);
+        int markerScope = profiler.begin("Light Markers");
+        renderQueue.execute(PASS_MARKERS);
+        profiler.end(markerScope);
+        if (drawMode == 2 && !cullOnGPU) cubeBatch.end();
 
-        lightVAO.bind();
-        for (int i = 0; i < 4; i++)
+        // next frame's occlusion test runs against what this frame drew
+        if (cullOnGPU && hiZOcclusion)
         {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, pointLightPositions[i]);
-            model = glm::scale(model, glm::vec3(0.2f));
-            lightObjShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            ProfileScope hiZScope(profiler, "Hi-Z Pyramid");
+            hiZBuffer.build(gBuffer.output, resWidth, resHeight, frame.projection * frame.view);
+        }
+        else hiZBuffer.valid = false;
+        if (headless && cullOnGPU) gpuCullingMismatches += gpuCuller.verify();
+
+        // the uniform traffic of the loop before the location cache: view, viewPos and projection by name, then a
+        // model by name per cube and per light marker, every name asked of the driver. none of these uniforms exist
+        // any more (FrameData and the instance attributes replaced them) so the writes go to -1 and change nothing,
+        // what's left is the lookups and calls the cache removed. with 10 cubes and 4 lights that's the old 19
+        if (baselineUniforms)
+        {
+            auto baselineStart = std::chrono::high_resolution_clock::now();
+            cubeShader.cachedLocations = lightObjShader.cachedLocations = false;
+            cubeShader.use();
+            cubeShader.setMat4("view", frame.view);
+            cubeShader.setVec3("viewPos", frame.viewPos);
+            cubeShader.setMat4("projection", frame.projection);
+            for (const glm::mat4& model : cubeModels) cubeShader.setMat4("model", model);
+            lightObjShader.use();
+            lightObjShader.setMat4("view", frame.view);
+            lightObjShader.setMat4("projection", frame.projection);
+            for (const glm::mat4& model : lightMarkerModels) lightObjShader.setMat4("model", model);
+            cubeShader.cachedLocations = lightObjShader.cachedLocations = true;
+            baselineUniformMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - baselineStart).count();
         }
-        lightVAO.unbind();
 
         // ImGui Menu Items
         {   
             ImGui::Begin("Debug Menu"); // Create a window called "Debug Menu" and append into it.
             ImGui::Text("Press M to toggle mouse");
             ImGui::Text("Model Rotation Matrix:");
-            ImGui::Checkbox("Continuous Spin", &spin); // Edit bools storing our window open/close state
-            ImGui::SliderFloat("Spin Speed", &spinSpeed, 0.0f, 10.0f);
-            if (spin) rotationdeg += spinSpeed;
+            ImGui::Checkbox("Continuous Spin", &simulationInput.spin); // Edit bools storing our window open/close state
+            ImGui::SliderFloat("Spin Speed (deg/tick)", &simulationInput.spinSpeed, 0.0f, 10.0f);
+            ImGui::Checkbox("Interpolate Ticks", &interpolateSimulation); // off draws the latest tick, which stutters
+            ImGui::Text("Simulation: %d Hz, %u ticks this frame, alpha %.2f, %u slow frames dropped", SIMULATION_TICK_RATE, simulation.ticks, simulation.alpha(), simulation.droppedFrames);
             ImGui::SliderFloat3("XYZ", glm::value_ptr(modelAxis), 0.01f, 1.0f);
+            ImGui::Text("Cube Field:");
+            ImGui::SliderInt("Cube Count", &cubeCount, 1, maxCubes, "%d", ImGuiSliderFlags_Logarithmic);
+            ImGui::Combo("Draw Mode", &drawMode, drawModes, 3);
+            ImGui::Text("Draw calls: %u, program changes: %u, VAO changes: %u, material changes: %u", renderQueue.draws, renderQueue.programChanges, renderQueue.vertexArrayChanges, renderQueue.materialChanges);
+            ImGui::Checkbox("Sort Front to Back", &frontToBack); // the instances and the render queue
+            if (ImGui::Button("Run Sort Benchmark (1M keys)")) runSortBenchmark(1000000, sortBenchmark);
+            ImGui::Text("Radix sort %.1f ms, std::sort %.1f ms", sortBenchmark[0], sortBenchmark[1]);
+            ImGui::Checkbox("Frustum Culling", &frustumCulling);
+            ImGui::Checkbox("GPU Culling (multi-draw mode)", &gpuCulling); // a compute pass instead of the CPU/BVH culling
+            if (ImGui::Button("Verify GPU Culling")) gpuCuller.verify();
+            ImGui::Text("Compute culling: %u visible, CPU reference: %u, mismatches: %u", gpuCuller.gpuVisible, gpuCuller.cpuVisible, gpuCuller.mismatches);
+            ImGui::Checkbox("Hi-Z Occlusion (GPU culling)", &hiZOcclusion);
+            ImGui::Text("Hi-Z: %u drawn, %u occluded (%d frames behind)", gpuCuller.drawn, gpuCuller.occluded, PERSISTENT_BUFFER_FRAMES);
+            ImGui::Checkbox("Software Occlusion (CPU culling)", &softwareOcclusion);
+            ImGui::Checkbox("Depth Pre-Pass", &depthPrepass);
+            ImGui::Text("Shaded fragments: %llu, %.2f per pixel (%d frames behind)", (unsigned long long)shadedSamples.samples, (double)shadedSamples.samples / (resWidth * resHeight), PROFILER_LATENCY);
+            ImGui::SliderInt("Occluders", &occluderCount, 1, 256);
+            ImGui::Text("Software: %zu occluded, %u occluders rasterized, %.3f ms", softwareOccluded, occlusionBuffer.occludersDrawn, occlusionMs);
+            if (ImGui::Button("Check Software Occlusion")) occlusionCheckFailures = runOcclusionCheck();
+            ImGui::SameLine();
+            if (occlusionCheckFailures < 0) ImGui::Text("not run");
+            else ImGui::Text("%d of 4 cases wrong", occlusionCheckFailures);
+            ImGui::Text("Cubes visible: %zu, culled: %zu", visibleCubes.size(), cubeCount - visibleCubes.size());
+            ImGui::Text("Light markers visible: %zu, culled: %zu", visibleLightMarkers.size(), pointLightCount - visibleLightMarkers.size());
+            ImGui::Text("Bounding Volume Hierarchy:");
+            ImGui::Checkbox("BVH Culling", &bvhCulling);
+            ImGui::Checkbox("Refit Instead Of Rebuild", &bvhRefit);
+            ImGui::Checkbox("Pick And Light Queries", &bvhQueries);
+            ImGui::Text("BVH %s: %.3f ms, %zu nodes", bvhRefit ? "refit" : "build", bvhMs, cubeBVH.nodes.size());
+            if (bvhQueries)
+            {
+                if (pickedCube >= 0) ImGui::Text("Picked cube %d at %.2f", pickedCube, pickDistance);
+                else ImGui::Text("Picked cube: none");
+                ImGui::Text("Cubes in reach of light 0: %zu", litCubes.size());
+            }
+            if (ImGui::Button("Run BVH Benchmark (1M objects)")) runBVHBenchmark(1000000, bvhBenchmark);
+            ImGui::Text("Build %.1f ms, refit %.1f ms", bvhBenchmark[0], bvhBenchmark[1]);
+            ImGui::Text("Frustum query %.2f ms, brute force %.2f ms", bvhBenchmark[2], bvhBenchmark[3]);
+            ImGui::Text("1000 raycasts %.2f ms", bvhBenchmark[4]);
+            ImGui::Text("Mipmaps:");
+            if (ImGui::Button("Run Mip Benchmark (4096x4096 sRGB)")) runMipBenchmark(4096, mipBenchmark);
+            ImGui::Text("Box: scalar %.1f ms, SSE %.1f ms, AVX %.1f ms", mipBenchmark[0], mipBenchmark[1], mipBenchmark[2]);
+            ImGui::Text("Kaiser: scalar %.1f ms, SSE %.1f ms, AVX %.1f ms", mipBenchmark[3], mipBenchmark[4], mipBenchmark[5]);
+#ifndef MIPMAP_AVX
+            ImGui::Text("(AVX not compiled in, it falls back to SSE. needs /arch:AVX)");
+#endif
+            ImGui::Text("Cube mesh: %u vertices, %d indices", cubeMesh.vertexCount(), cubeIndexCount);
+            ImGui::Text("Mesh arena: %zu meshes, %u vertices, %zu indices", meshArena.meshes.size(), meshArena.vertexCount(), meshArena.indices.size());
+            ImGui::Text("Multi-draw: %u commands, %u waits on the GPU", cubeBatch.drawCount, cubeBatch.commands.waits + cubeBatch.drawData.waits);
+            ImGui::Text("ACMR: 3.00 unindexed, %.2f welded, %.2f optimized", weldedACMR, optimizedACMR);
+            if (ImGui::Button("Run ACMR Benchmark (shuffled 64x64 grid)")) runACMRBenchmark(64, vertexCacheSize, acmrBenchmark);
+            ImGui::Text("Grid ACMR: %.2f shuffled, %.2f optimized, in %.2f ms", acmrBenchmark[0], acmrBenchmark[1], acmrBenchmark[2]);
+            ImGui::Checkbox("CPU Normal Matrices", &cpuNormals); // off uses the GPU_NORMAL_MATRIX variant's per vertex inverse
+            ImGui::Checkbox("Specular Map", &specularMapping);
+            ImGui::SameLine();
+            ImGui::Checkbox("Point Lights", &pointLighting);
+            ImGui::Text("Shader variants: %zu forward, %zu geometry pass", forwardShaders.variants.size(), gBufferShaders.variants.size());
+            ImGui::Combo("Render Mode", &renderMode, renderModes, 2);
+            ImGui::Text("Clustered Lighting:");
+            ImGui::SliderInt("Point Lights", &pointLightCount, 4, maxPointLights, "%d", ImGuiSliderFlags_Logarithmic);
+            ImGui::Text("Light binning: %.3f ms on %u threads", clusterMs, threadPool.size() + 1);
+            ImGui::Text("Light indices: %zu, max per cluster: %u", lightClusters.lightIndices.size(), lightClusters.maxLightsPerCluster);
             ImGui::Text("FOV:");
             ImGui::SliderFloat("FOV Scale", &camera.fov, 1.0f, 120.0f);
             ImGui::Text("Yaw and Pitch");
@@ -275,16 +949,56 @@ int main()
 
             ImGui::Text("Application avg %.3f ms/frame", 1000.0f / io.Framerate);
             ImGui::Text("%.1f FPS", io.Framerate);
+            ImGui::Text("Startup: %.1f ms, textures uploaded: %u, pending: %u", startupMs, textureLoader.uploaded, textureLoader.pending());
+            ImGui::Text("Shaders: %.1f ms at startup, %u from the program cache, %u compiled", shaderMs, programCache().hits, programCache().misses);
+            ImGui::Text("Shader reloads: %u, failed: %u, last rebuild: %.1f ms", shaderWatcher.reloads, shaderWatcher.failures, shaderWatcher.lastReloadMs);
+            if (packed) ImGui::Text("Assets: assets.pack, %zu files mapped", assetPack().entryCount());
+            else ImGui::Text("Assets: loose files");
+            ImGui::Text("GL state calls/frame: %u issued, %u redundant ones skipped", stateCallsIssued, stateCallsSkipped);
+            ImGui::Text("Uniform writes/frame: %u", cubeShader.uniformWrites + lightObjShader.uniformWrites);
+            ImGui::Text("Uniform location queries/frame: %u", cubeShader.locationQueries + lightObjShader.locationQueries);
+            ImGui::Checkbox("Baseline Uniform Lookups", &baselineUniforms); // the old loop's by-name setters, uncached
+            ImGui::Text("Baseline lookups and writes: %.3f ms", baselineUniformMs);
 
             ImGui::End();
         }
 
+        profiler.drawImGui();
+
         // Rendering
+        int imguiScope = profiler.begin("ImGui");
         ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        if (!headless) ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        profiler.end(imguiScope);
+        profiler.endFrame();
 
-        glfwSwapBuffers(window);
+        if (headless)
+        {
+            char path[32];
+            snprintf(path, sizeof(path), "/frame_%04d.png", frameNumber);
+            capture.capture(captureDir + path);
+        }
+        else glfwSwapBuffers(window);
         glfwPollEvents();
+        frameNumber++;
+    }
+
+    if (headless)
+    {
+        capture.finish();
+        profiler.flush();
+        std::ofstream csv(captureDir + "/timings.csv");
+        csv << "frame,cpu_ms,gpu_ms\n";
+        for (const Profiler::FrameTiming& timing : profiler.timings)
+            csv << timing.frame << "," << timing.cpuTime << "," << timing.gpuTime << "\n";
+        if (!csv) std::cout << "ERROR::CAPTURE::FILE_NOT_WRITTEN: " << captureDir << "/timings.csv" << std::endl;
+
+        // run once with --no-program-cache and twice without to compare a cold start against a cached one
+        std::ofstream startup(captureDir + "/startup.csv");
+        startup << "startup_ms,shader_ms,program_cache_hits,program_cache_misses\n";
+        startup << startupMs << "," << shaderMs << "," << programCache().hits << "," << programCache().misses << "\n";
+        if (startGPUCulling) std::cout << "GPU culling: " << gpuCullingMismatches << " objects differed from the CPU reference over " << frameNumber << " frames" << std::endl;
+        std::cout << "Startup: " << startupMs << " ms, shaders: " << shaderMs << " ms (" << programCache().hits << " cached, " << programCache().misses << " compiled)" << std::endl;
     }
 
     // Cleanup
@@ -293,7 +1007,27 @@ int main()
     ImGui::DestroyContext();
 
     glDeleteVertexArrays(1, &va.ID);
+    glDeleteVertexArrays(1, &lightVAO.ID);
+    glDeleteVertexArrays(1, &volumeVAO.ID);
+    glDeleteVertexArrays(1, &emptyVAO.ID);
+    gBuffer.destroy();
+    profiler.destroy();
+    textureLoader.destroy();
+    cubeBatch.destroy();
+    gpuCuller.destroy();
+    hiZBuffer.destroy();
+    shadedSamples.destroy();
+    shaderWatcher.destroy();
+    if (headless) capture.destroy();
     glDeleteBuffers(1, &vb.ID);
+    glDeleteBuffers(1, &eb.ID);
+    glDeleteBuffers(1, &frameUBO.ID);
+    glDeleteBuffers(1, &lightUBO.ID);
+    glDeleteBuffers(1, &pointLightSSBO.ID);
+    glDeleteBuffers(1, &clusterSSBO.ID);
+    glDeleteBuffers(1, &clusterIndexSSBO.ID);
+    glDeleteBuffers(1, &cubeInstances.vb.ID);
+    glDeleteBuffers(1, &lightInstances.vb.ID);
     glfwTerminate();
     return 0;
 }
@@ -339,3 +1073,151 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     if (mouseToggle) glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
     else glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 }
+
+// random boxes in a 200 unit cube: build, refit after moving them all, one frustum query against the brute
+// force cull, then 1000 random raycasts. results are in ms, in that order
+void runBVHBenchmark(size_t objectCount, float results[5])
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> size(0.1f, 1.0f);
+    BoundsList bounds;
+    bounds.resize(objectCount);
+    for (size_t i = 0; i < objectCount; i++)
+        bounds.set(i, glm::vec3(position(rng), position(rng), position(rng)), glm::vec3(size(rng)));
+
+    BVH bvh;
+    auto start = std::chrono::high_resolution_clock::now();
+    bvh.build(bounds);
+    auto end = std::chrono::high_resolution_clock::now();
+    results[0] = std::chrono::duration<float, std::milli>(end - start).count();
+
+    for (size_t i = 0; i < objectCount; i++) bounds.centerX[i] += 0.25f;
+    start = std::chrono::high_resolution_clock::now();
+    bvh.refit(bounds);
+    end = std::chrono::high_resolution_clock::now();
+    results[1] = std::chrono::duration<float, std::milli>(end - start).count();
+
+    Frustum frustum = Frustum::fromMatrix(glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f)
+        * glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.2f, 0.3f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    std::vector<unsigned int> visible;
+    start = std::chrono::high_resolution_clock::now();
+    bvh.cullFrustum(frustum, bounds, visible);
+    end = std::chrono::high_resolution_clock::now();
+    results[2] = std::chrono::duration<float, std::milli>(end - start).count();
+
+    visible.clear();
+    start = std::chrono::high_resolution_clock::now();
+    cullBounds(frustum, bounds, visible);
+    end = std::chrono::high_resolution_clock::now();
+    results[3] = std::chrono::duration<float, std::milli>(end - start).count();
+
+    std::vector<glm::vec3> origins, directions;
+    for (int i = 0; i < 1000; i++)
+    {
+        origins.push_back(glm::vec3(position(rng), position(rng), position(rng)));
+        directions.push_back(glm::normalize(glm::vec3(position(rng), position(rng), position(rng))));
+    }
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < 1000; i++)
+    {
+        float distance;
+        bvh.raycast(origins[i], directions[i], bounds, distance);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    results[4] = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+// full sRGB mip chain of a noise image of size x size, box then Kaiser, each on the scalar, SSE and AVX paths
+void runMipBenchmark(int size, float results[6])
+{
+    std::vector<unsigned char> pixels((size_t)size * size * 4);
+    std::mt19937 rng(7);
+    for (unsigned char& pixel : pixels) pixel = (unsigned char)(rng() & 255);
+
+    MipFilter filters[] = { MIP_BOX, MIP_KAISER };
+    MipPath paths[] = { MIP_SCALAR, MIP_SSE, MIP_AVX };
+    for (int f = 0; f < 2; f++)
+        for (int p = 0; p < 3; p++)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            generateMipChain(pixels.data(), size, size, filters[f], true, paths[p]);
+            results[f * 3 + p] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        }
+}
+
+// count random draw keys (the state bits drawn from a handful of programs and materials, random depths) sorted with
+// radixSort and with std::sort on the same input. results are in ms, in that order
+void runSortBenchmark(size_t count, float results[2])
+{
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> depth(0.1f, 100.0f);
+    std::vector<SortEntry> entries(count), scratch;
+    for (size_t i = 0; i < count; i++)
+        entries[i] = { RenderQueue::opaqueKey(rng() & 1, rng() & 7, rng() & 15, depthBits(depth(rng))), (uint32_t)i };
+    std::vector<SortEntry> copy = entries;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    radixSort(entries, scratch);
+    results[0] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    std::sort(copy.begin(), copy.end(), [](const SortEntry& a, const SortEntry& b) { return a.key < b.key; });
+    results[1] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// a gridSize x gridSize quad grid with its triangles in random order, the case the cube is too small to show: its
+// ACMR through a cacheSize FIFO before and after optimizeVertexCache, and the optimization's time in ms
+void runACMRBenchmark(int gridSize, int cacheSize, float results[3])
+{
+    std::vector<unsigned int> indices;
+    unsigned int row = gridSize + 1;
+    for (int y = 0; y < gridSize; y++)
+        for (int x = 0; x < gridSize; x++)
+        {
+            unsigned int corner = y * row + x;
+            unsigned int quad[6] = { corner, corner + 1, corner + row, corner + 1, corner + row + 1, corner + row };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    std::mt19937 rng(4);
+    std::vector<unsigned int> order(indices.size() / 3);
+    for (size_t i = 0; i < order.size(); i++) order[i] = (unsigned int)i;
+    std::shuffle(order.begin(), order.end(), rng);
+    std::vector<unsigned int> shuffled;
+    for (unsigned int triangle : order) shuffled.insert(shuffled.end(), indices.begin() + triangle * 3, indices.begin() + triangle * 3 + 3);
+
+    results[0] = computeACMR(shuffled, cacheSize);
+    auto start = std::chrono::high_resolution_clock::now();
+    optimizeVertexCache(shuffled, row * row, cacheSize);
+    results[2] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    results[1] = computeACMR(shuffled, cacheSize);
+}
+
+// the software occlusion buffer against a known scene: one tilted 2x2x2 occluder 5 units down -Z, and a box hidden
+// behind it, one beside it, one in front of it and one around it. only the first may come out occluded, anything
+// else means the buffer claims coverage it doesn't have. returns the cases that came out wrong
+int runOcclusionCheck()
+{
+    OcclusionBuffer buffer;
+    buffer.clear(glm::perspective(glm::radians(45.0f), 2.0f, 0.1f, 100.0f), 0.1f);
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -5.0f));
+    model = glm::rotate(model, 0.5f, glm::vec3(0.3f, 1.0f, 0.2f));
+    buffer.drawBox(glm::scale(model, glm::vec3(2.0f)));
+    buffer.finish();
+
+    struct Case { const char* name; glm::vec3 center, extent; bool occluded; };
+    const Case cases[] = {
+        { "hidden", glm::vec3(0.0f, 0.0f, -10.0f), glm::vec3(0.5f), true },
+        { "beside", glm::vec3(4.0f, 0.0f, -10.0f), glm::vec3(0.5f), false },
+        { "in front", glm::vec3(0.0f, 0.0f, -2.5f), glm::vec3(0.25f), false },
+        { "around", glm::vec3(0.0f, 0.0f, -5.0f), glm::vec3(1.5f), false },
+    };
+    int failures = 0;
+    for (const Case& check : cases)
+    {
+        if (buffer.isOccluded(check.center, check.extent) == check.occluded) continue;
+        std::cout << "ERROR::OCCLUSION::CHECK_FAILED: " << check.name << std::endl;
+        failures++;
+    }
+    return failures;
+}
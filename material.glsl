@@ -0,0 +1,18 @@
+struct Material
+{
+	sampler2D diffuse;
+	sampler2D specular;
+	float shininess;
+};
+
+uniform Material material;
+
+// without SPECULAR_MAP every surface gets the same flat specular colour and the texture fetch is compiled out
+vec3 materialSpecular(vec2 texCoords)
+{
+#ifdef SPECULAR_MAP
+	return texture(material.specular, texCoords).rgb;
+#else
+	return vec3(0.5);
+#endif
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <cstddef>
+#include <utility>
+
+// An indexed triangle list with interleaved vertex data, built from the flat arrays in vertices.h
+struct Mesh
+{
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	int floatsPerVertex;
+
+	unsigned int vertexCount() const { return (unsigned int)(vertices.size() / floatsPerVertex); }
+};
+
+// where one mesh's triangles sit inside a MeshArena's shared arrays
+struct MeshRange
+{
+	unsigned int firstIndex, indexCount;
+	int baseVertex;
+};
+
+// Meshes with the same vertex layout packed back to back into one vertex and one index array, so one vertex array
+// can draw any of them and one multi-draw call can draw all of them. Indices stay relative to their own mesh and
+// baseVertex moves them to where its vertices ended up
+struct MeshArena
+{
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<MeshRange> meshes;
+	int floatsPerVertex;
+
+	explicit MeshArena(int floatsPerVertex) : floatsPerVertex(floatsPerVertex) {}
+
+	unsigned int vertexCount() const { return (unsigned int)(vertices.size() / floatsPerVertex); }
+
+	// returns the mesh's index into meshes
+	unsigned int add(const Mesh& mesh)
+	{
+		meshes.push_back({ (unsigned int)indices.size(), (unsigned int)mesh.indices.size(), (int)vertexCount() });
+		vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+		indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+		return (unsigned int)meshes.size() - 1;
+	}
+};
+
+// merges bit-identical vertices of a non-indexed triangle list, i.e. the 36 vertex cube collapses to 24
+// (every face keeps its own 4 corners because the normals and uvs differ between faces)
+inline Mesh weldVertices(const float* vertices, size_t floatCount, int floatsPerVertex)
+{
+	Mesh mesh;
+	mesh.floatsPerVertex = floatsPerVertex;
+	std::map<std::vector<float>, unsigned int> seen;
+	for (size_t i = 0; i + floatsPerVertex <= floatCount; i += floatsPerVertex)
+	{
+		std::vector<float> vertex(vertices + i, vertices + i + floatsPerVertex);
+		auto it = seen.find(vertex);
+		if (it == seen.end())
+		{
+			unsigned int index = mesh.vertexCount();
+			mesh.vertices.insert(mesh.vertices.end(), vertex.begin(), vertex.end());
+			it = seen.emplace(vertex, index).first;
+		}
+		mesh.indices.push_back(it->second);
+	}
+	return mesh;
+}
+
+// flips every triangle whose winding disagrees with its vertex normals (read at normalOffset floats into each
+// vertex), leaving the mesh counter-clockwise when seen from outside so face culling can be trusted
+inline void orientTriangles(Mesh& mesh, int normalOffset)
+{
+	for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+	{
+		const float* a = &mesh.vertices[mesh.indices[t] * mesh.floatsPerVertex];
+		const float* b = &mesh.vertices[mesh.indices[t + 1] * mesh.floatsPerVertex];
+		const float* c = &mesh.vertices[mesh.indices[t + 2] * mesh.floatsPerVertex];
+		float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float cross[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		const float* n = a + normalOffset;
+		if (cross[0] * n[0] + cross[1] * n[1] + cross[2] * n[2] < 0.0f)
+			std::swap(mesh.indices[t + 1], mesh.indices[t + 2]);
+	}
+}
+
+// average cache miss ratio: vertex shader invocations per triangle through a FIFO post-transform cache of
+// cacheSize entries. 3.0 is the worst case (nothing reused), 0.5 the limit for large regular grids
+inline float computeACMR(const std::vector<unsigned int>& indices, int cacheSize)
+{
+	if (indices.size() < 3) return 0.0f;
+	std::vector<unsigned int> fifo;
+	unsigned int misses = 0;
+	for (unsigned int index : indices)
+	{
+		bool hit = false;
+		for (unsigned int cached : fifo)
+			if (cached == index) { hit = true; break; }
+		if (hit) continue;
+
+		misses++;
+		fifo.push_back(index);
+		if ((int)fifo.size() > cacheSize) fifo.erase(fifo.begin());
+	}
+	return (float)misses / (float)(indices.size() / 3);
+}
+
+// Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+// Fans out triangles around one vertex at a time, then moves on to whichever recently emitted vertex still
+// has triangles left and is likely to still be in a cache of cacheSize entries
+inline void optimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount, int cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || vertexCount == 0) return;
+
+	// vertex -> triangles adjacency, stored as offsets into one flat list
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (unsigned int index : indices) liveTriangles[index]++;
+	std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+	for (unsigned int v = 0; v < vertexCount; v++) adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+	std::vector<unsigned int> adjacency(adjacencyOffset[vertexCount]);
+	std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+	std::vector<int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+
+	int fanning = 0;
+	int timeStamp = cacheSize + 1;
+	unsigned int cursor = 1;
+	while (fanning >= 0)
+	{
+		std::vector<unsigned int> candidates;
+		for (unsigned int a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; a++)
+		{
+			unsigned int triangle = adjacency[a];
+			if (emitted[triangle]) continue;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				unsigned int v = indices[triangle * 3 + corner];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (timeStamp - cacheTime[v] > cacheSize) cacheTime[v] = timeStamp++;
+			}
+			emitted[triangle] = true;
+		}
+
+		// prefer the candidate with the most remaining triangles that will still be cached after emitting them
+		fanning = -1;
+		int bestPriority = -1;
+		for (unsigned int v : candidates)
+		{
+			if (liveTriangles[v] == 0) continue;
+			int priority = 0;
+			if (timeStamp - cacheTime[v] + 2 * (int)liveTriangles[v] <= cacheSize) priority = timeStamp - cacheTime[v];
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				fanning = (int)v;
+			}
+		}
+
+		// dead end: back up through recently emitted vertices, then fall back to scanning in input order
+		while (fanning < 0 && !deadEnd.empty())
+		{
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0) fanning = (int)v;
+		}
+		while (fanning < 0 && cursor < vertexCount)
+		{
+			if (liveTriangles[cursor] > 0) fanning = (int)cursor;
+			cursor++;
+		}
+	}
+	indices.swap(output);
+}
@@ -0,0 +1,323 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <immintrin.h>
+#define MIPMAP_SSE
+#endif
+#if defined(__AVX__)
+#define MIPMAP_AVX
+#endif
+
+// Mip chains built on the CPU instead of glGenerateMipmap, so they can be made on a loader thread or offline and
+// are the same on every driver. Filtering happens on linear light floats: colour channels are decoded from sRGB
+// first (alpha never is) and only rounded back to 8 bits once per level, so errors don't pile up down the chain.
+
+enum MipFilter { MIP_BOX, MIP_KAISER };
+enum MipPath { MIP_SCALAR, MIP_SSE, MIP_AVX }; // falls back to the widest one compiled in
+
+#if defined(MIPMAP_AVX)
+#define MIP_BEST MIP_AVX
+#elif defined(MIPMAP_SSE)
+#define MIP_BEST MIP_SSE
+#else
+#define MIP_BEST MIP_SCALAR
+#endif
+
+// the tables are function local statics so the loader threads can share them, C++11 initializes those exactly once
+inline const float* srgbDecodeTable()
+{
+	struct Table
+	{
+		float values[256];
+		Table()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+		}
+	};
+	static const Table table;
+	return table.values;
+}
+
+// 16k entries, close enough that a sRGB -> linear -> sRGB round trip gives back every 8 bit value
+inline const unsigned char* srgbEncodeTable()
+{
+	struct Table
+	{
+		unsigned char values[16384];
+		Table()
+		{
+			for (int i = 0; i < 16384; i++)
+			{
+				float c = i / 16383.0f;
+				float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+				values[i] = (unsigned char)(s * 255.0f + 0.5f);
+			}
+		}
+	};
+	static const Table table;
+	return table.values;
+}
+
+inline float srgbToLinear(unsigned char value)
+{
+	return srgbDecodeTable()[value];
+}
+
+inline unsigned char linearToSrgb(float value)
+{
+	return srgbEncodeTable()[(int)(std::min(std::max(value, 0.0f), 1.0f) * 16383.0f + 0.5f)];
+}
+
+// rounds count RGBA float pixels back to 8 bits, colour through the sRGB table when srgb is set
+inline void encodePixels(const float* pixels, size_t count, bool srgb, unsigned char* out, MipPath path)
+{
+	const unsigned char* encode = srgbEncodeTable();
+	float colorScale = srgb ? 16383.0f : 255.0f;
+	size_t i = 0;
+#ifdef MIPMAP_SSE
+	if (path != MIP_SCALAR)
+	{
+		__m128 scale = _mm_setr_ps(colorScale, colorScale, colorScale, 255.0f);
+		for (; i < count; i++)
+		{
+			__m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pixels + i * 4), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+			__m128i index = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), _mm_set1_ps(0.5f)));
+			int r = _mm_cvtsi128_si32(index), g = _mm_cvtsi128_si32(_mm_srli_si128(index, 4));
+			int b = _mm_cvtsi128_si32(_mm_srli_si128(index, 8)), a = _mm_cvtsi128_si32(_mm_srli_si128(index, 12));
+			out[i * 4] = (unsigned char)(srgb ? encode[r] : r);
+			out[i * 4 + 1] = (unsigned char)(srgb ? encode[g] : g);
+			out[i * 4 + 2] = (unsigned char)(srgb ? encode[b] : b);
+			out[i * 4 + 3] = (unsigned char)a;
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			int index = (int)(std::min(std::max(pixels[i * 4 + c], 0.0f), 1.0f) * (c < 3 ? colorScale : 255.0f) + 0.5f);
+			out[i * 4 + c] = (unsigned char)(srgb && c < 3 ? encode[index] : index);
+		}
+	}
+}
+
+// 8 tap Kaiser windowed sinc for halving, taps sit at -3.5 to 3.5 source texels around the destination centre.
+// sharper than a box filter, at the cost of a little ringing that gets clamped on the way back to 8 bits
+inline const float* kaiserWeights()
+{
+	struct Weights
+	{
+		float values[8];
+		Weights()
+		{
+			// zeroth order modified Bessel function of the first kind, by its series
+			auto bessel = [](float x)
+			{
+				float sum = 1.0f, term = 1.0f;
+				for (int k = 1; k < 20; k++)
+				{
+					term *= (x / (2.0f * k)) * (x / (2.0f * k));
+					sum += term;
+				}
+				return sum;
+			};
+			const float alpha = 4.0f, radius = 4.0f, pi = 3.14159265f;
+			float total = 0.0f;
+			for (int i = 0; i < 8; i++)
+			{
+				float d = i - 3.5f;
+				float x = d * 0.5f * pi; // sinc with its first zero at 2 source texels, the destination spacing
+				float ratio = d / radius;
+				values[i] = std::sin(x) / x * bessel(alpha * std::sqrt(1.0f - ratio * ratio)) / bessel(alpha);
+				total += values[i];
+			}
+			for (int i = 0; i < 8; i++) values[i] /= total;
+		}
+	};
+	static const Weights weights;
+	return weights.values;
+}
+
+// halves an RGBA float image by averaging 2x2 blocks. odd sizes reuse the last row/column
+inline void downsampleBox(const float* src, int width, int height, float* dst, MipPath path)
+{
+	int dstWidth = std::max(1, width / 2), dstHeight = std::max(1, height / 2);
+	for (int y = 0; y < dstHeight; y++)
+	{
+		const float* row0 = src + (size_t)std::min(y * 2, height - 1) * width * 4;
+		const float* row1 = src + (size_t)std::min(y * 2 + 1, height - 1) * width * 4;
+		float* out = dst + (size_t)y * dstWidth * 4;
+		int x = 0;
+#ifdef MIPMAP_AVX
+		// two destination pixels (four source columns) per iteration
+		if (path == MIP_AVX)
+		{
+			for (; x + 2 <= dstWidth && x * 2 + 3 < width; x += 2)
+			{
+				__m256 a = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8), _mm256_loadu_ps(row1 + x * 8));
+				__m256 b = _mm256_add_ps(_mm256_loadu_ps(row0 + x * 8 + 8), _mm256_loadu_ps(row1 + x * 8 + 8));
+				__m256 sum = _mm256_add_ps(_mm256_permute2f128_ps(a, b, 0x20), _mm256_permute2f128_ps(a, b, 0x31));
+				_mm256_storeu_ps(out + x * 4, _mm256_mul_ps(sum, _mm256_set1_ps(0.25f)));
+			}
+		}
+#endif
+#ifdef MIPMAP_SSE
+		if (path != MIP_SCALAR)
+		{
+			for (; x < dstWidth; x++)
+			{
+				int x0 = std::min(x * 2, width - 1) * 4, x1 = std::min(x * 2 + 1, width - 1) * 4;
+				__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+					_mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+				_mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+			}
+		}
+#endif
+		for (; x < dstWidth; x++)
+		{
+			int x0 = std::min(x * 2, width - 1) * 4, x1 = std::min(x * 2 + 1, width - 1) * 4;
+			for (int c = 0; c < 4; c++)
+				out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+		}
+	}
+}
+
+// halves an RGBA float image with the Kaiser filter, separably: rows into scratch (dstWidth x height), then
+// columns into dst. edge texels are repeated
+inline void downsampleKaiser(const float* src, int width, int height, float* dst, std::vector<float>& scratch, MipPath path)
+{
+	const float* weights = kaiserWeights();
+	int dstWidth = std::max(1, width / 2), dstHeight = std::max(1, height / 2);
+	scratch.resize((size_t)dstWidth * height * 4);
+
+	for (int y = 0; y < height; y++)
+	{
+		const float* row = src + (size_t)y * width * 4;
+		float* out = &scratch[(size_t)y * dstWidth * 4];
+		int x = 0;
+#ifdef MIPMAP_AVX
+		// two destination pixels per register, their taps are 2 source texels apart
+		if (path == MIP_AVX)
+		{
+			for (; x + 2 <= dstWidth; x += 2)
+			{
+				__m256 sum = _mm256_setzero_ps();
+				for (int i = 0; i < 8; i++)
+				{
+					int sx0 = std::min(std::max(x * 2 - 3 + i, 0), width - 1), sx1 = std::min(std::max(x * 2 - 1 + i, 0), width - 1);
+					__m256 pair = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(row + sx0 * 4)), _mm_loadu_ps(row + sx1 * 4), 1);
+					sum = _mm256_add_ps(sum, _mm256_mul_ps(pair, _mm256_set1_ps(weights[i])));
+				}
+				_mm256_storeu_ps(out + x * 4, sum);
+			}
+		}
+#endif
+#ifdef MIPMAP_SSE
+		if (path != MIP_SCALAR)
+		{
+			for (; x < dstWidth; x++)
+			{
+				__m128 sum = _mm_setzero_ps();
+				for (int i = 0; i < 8; i++)
+				{
+					int sx = std::min(std::max(x * 2 - 3 + i, 0), width - 1);
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + sx * 4), _mm_set1_ps(weights[i])));
+				}
+				_mm_storeu_ps(out + x * 4, sum);
+			}
+		}
+#endif
+		for (; x < dstWidth; x++)
+		{
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < 8; i++)
+			{
+				int sx = std::min(std::max(x * 2 - 3 + i, 0), width - 1);
+				for (int c = 0; c < 4; c++) sum[c] += row[sx * 4 + c] * weights[i];
+			}
+			for (int c = 0; c < 4; c++) out[x * 4 + c] = sum[c];
+		}
+	}
+
+	// the vertical pass runs along whole rows, so it vectorizes over consecutive floats
+	size_t rowFloats = (size_t)dstWidth * 4;
+	for (int y = 0; y < dstHeight; y++)
+	{
+		const float* rows[8];
+		for (int i = 0; i < 8; i++)
+			rows[i] = &scratch[(size_t)std::min(std::max(y * 2 - 3 + i, 0), height - 1) * rowFloats];
+		float* out = dst + (size_t)y * rowFloats;
+		size_t f = 0;
+#ifdef MIPMAP_AVX
+		if (path == MIP_AVX)
+		{
+			for (; f + 8 <= rowFloats; f += 8)
+			{
+				__m256 sum = _mm256_setzero_ps();
+				for (int i = 0; i < 8; i++)
+					sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(rows[i] + f), _mm256_set1_ps(weights[i])));
+				_mm256_storeu_ps(out + f, sum);
+			}
+		}
+#endif
+#ifdef MIPMAP_SSE
+		if (path != MIP_SCALAR)
+		{
+			for (; f + 4 <= rowFloats; f += 4)
+			{
+				__m128 sum = _mm_setzero_ps();
+				for (int i = 0; i < 8; i++)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[i] + f), _mm_set1_ps(weights[i])));
+				_mm_storeu_ps(out + f, sum);
+			}
+		}
+#endif
+		for (; f < rowFloats; f++)
+		{
+			float sum = 0.0f;
+			for (int i = 0; i < 8; i++) sum += rows[i][f] * weights[i];
+			out[f] = sum;
+		}
+	}
+}
+
+// every level below the given RGBA8 image, down to 1x1, each as RGBA8. level 0 itself is not included
+inline std::vector<std::vector<unsigned char>> generateMipChain(const unsigned char* pixels, int width, int height, MipFilter filter, bool srgb, MipPath path = MIP_BEST)
+{
+	std::vector<std::vector<unsigned char>> levels;
+	std::vector<float> current((size_t)width * height * 4), next, scratch;
+	float linear[256];
+	for (int i = 0; i < 256; i++) linear[i] = i / 255.0f;
+	const float* decode = srgb ? srgbDecodeTable() : linear;
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		current[i * 4] = decode[pixels[i * 4]];
+		current[i * 4 + 1] = decode[pixels[i * 4 + 1]];
+		current[i * 4 + 2] = decode[pixels[i * 4 + 2]];
+		current[i * 4 + 3] = linear[pixels[i * 4 + 3]];
+	}
+
+	while (width > 1 || height > 1)
+	{
+		int nextWidth = std::max(1, width / 2), nextHeight = std::max(1, height / 2);
+		next.resize((size_t)nextWidth * nextHeight * 4);
+		if (filter == MIP_KAISER) downsampleKaiser(current.data(), width, height, next.data(), scratch, path);
+		else downsampleBox(current.data(), width, height, next.data(), path);
+
+		levels.push_back(std::vector<unsigned char>(next.size()));
+		encodePixels(next.data(), (size_t)nextWidth * nextHeight, srgb, levels.back().data(), path);
+
+		current.swap(next);
+		width = nextWidth;
+		height = nextHeight;
+	}
+	return levels;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "buffer.h"
+#include "mesh.h"
+#include "renderstate.h"
+#include "uniformblocks.h"
+
+// the layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER, one per draw
+struct DrawElementsIndirectCommand
+{
+	unsigned int count;
+	unsigned int instanceCount;
+	unsigned int firstIndex;
+	int baseVertex;
+	unsigned int baseInstance;
+};
+
+inline void setDrawData(DrawData& draw, const glm::mat4& model, const glm::mat3& normalMatrix)
+{
+	draw.model = model;
+	for (int column = 0; column < 3; column++) draw.normalMatrix[column] = glm::vec4(normalMatrix[column], 0.0f);
+}
+
+// Draws of meshes from one MeshArena written as indirect commands, plus a DrawData entry for each one that the
+// MULTI_DRAW vertex shader picks up with gl_DrawID, so the whole batch goes out in a single
+// glMultiDrawElementsIndirect no matter how many meshes and transforms are in it. Both live in persistently
+// mapped buffers and are written in place every frame
+class MultiDrawBatch
+{
+public:
+	PersistentBuffer commands;
+	PersistentBuffer drawData;
+	unsigned int drawCount = 0;
+
+	MultiDrawBatch() : commands(GL_DRAW_INDIRECT_BUFFER), drawData(GL_SHADER_STORAGE_BUFFER)
+	{
+		int alignment = 0;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		drawData.alignment = alignment > 0 ? (unsigned int)alignment : 256;
+	}
+
+	// starts this frame's batch with room for maxDraws and points the DrawDataBlock binding at it
+	void begin(unsigned int maxDraws)
+	{
+		capacity = maxDraws > 0 ? maxDraws : 1;
+		drawCount = 0;
+		commandData = (DrawElementsIndirectCommand*)commands.begin(capacity * sizeof(DrawElementsIndirectCommand));
+		draws = (DrawData*)drawData.begin(capacity * sizeof(DrawData));
+		renderState().bindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_STORAGE_BINDING, drawData.ID, drawData.offset(), capacity * sizeof(DrawData));
+	}
+
+	// one draw of the mesh with the given transform. past maxDraws it's dropped
+	void add(const MeshRange& mesh, const glm::mat4& model, const glm::mat3& normalMatrix)
+	{
+		if (drawCount >= capacity) return;
+		commandData[drawCount] = { mesh.indexCount, 1, mesh.firstIndex, mesh.baseVertex, 0 };
+		setDrawData(draws[drawCount], model, normalMatrix);
+		drawCount++;
+	}
+
+	// after the draw reading this frame's batch was issued
+	void end()
+	{
+		commands.end();
+		drawData.end();
+	}
+
+	// byte offset of this frame's commands in the indirect buffer
+	unsigned int commandOffset() const
+	{
+		return commands.offset();
+	}
+
+	void destroy()
+	{
+		commands.destroy();
+		drawData.destroy();
+	}
+
+private:
+	unsigned int capacity = 0;
+	DrawElementsIndirectCommand* commandData = NULL;
+	DrawData* draws = NULL;
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "instancing.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define NORMALMATRIX_SSE
+#endif
+
+// The normal matrix is transpose(inverse(mat3(model))), which for a 3x3 is just its cofactor matrix divided by
+// the determinant. Writing it out by hand lets the SSE path below do 4 objects per instruction in SoA form,
+// with the scalar version handling the leftovers (and everything on targets without SSE).
+inline void computeNormalMatrix(InstanceData& instance)
+{
+	const glm::mat4& m = instance.model;
+	// a<row><column>, glm stores columns first
+	float a00 = m[0][0], a01 = m[1][0], a02 = m[2][0];
+	float a10 = m[0][1], a11 = m[1][1], a12 = m[2][1];
+	float a20 = m[0][2], a21 = m[1][2], a22 = m[2][2];
+
+	float c00 = a11 * a22 - a12 * a21, c01 = a12 * a20 - a10 * a22, c02 = a10 * a21 - a11 * a20;
+	float c10 = a02 * a21 - a01 * a22, c11 = a00 * a22 - a02 * a20, c12 = a01 * a20 - a00 * a21;
+	float c20 = a01 * a12 - a02 * a11, c21 = a02 * a10 - a00 * a12, c22 = a00 * a11 - a01 * a10;
+	float invDet = 1.0f / (a00 * c00 + a01 * c01 + a02 * c02);
+
+	glm::mat3& n = instance.normalMatrix;
+	n[0][0] = c00 * invDet; n[1][0] = c01 * invDet; n[2][0] = c02 * invDet;
+	n[0][1] = c10 * invDet; n[1][1] = c11 * invDet; n[2][1] = c12 * invDet;
+	n[0][2] = c20 * invDet; n[1][2] = c21 * invDet; n[2][2] = c22 * invDet;
+}
+
+inline void computeNormalMatrices(InstanceData* instances, size_t count)
+{
+	size_t i = 0;
+#ifdef NORMALMATRIX_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		InstanceData& p = instances[i];
+		InstanceData& q = instances[i + 1];
+		InstanceData& r = instances[i + 2];
+		InstanceData& s = instances[i + 3];
+#define NORMALMATRIX_GATHER(col, row) _mm_setr_ps(p.model[col][row], q.model[col][row], r.model[col][row], s.model[col][row])
+		__m128 a00 = NORMALMATRIX_GATHER(0, 0), a01 = NORMALMATRIX_GATHER(1, 0), a02 = NORMALMATRIX_GATHER(2, 0);
+		__m128 a10 = NORMALMATRIX_GATHER(0, 1), a11 = NORMALMATRIX_GATHER(1, 1), a12 = NORMALMATRIX_GATHER(2, 1);
+		__m128 a20 = NORMALMATRIX_GATHER(0, 2), a21 = NORMALMATRIX_GATHER(1, 2), a22 = NORMALMATRIX_GATHER(2, 2);
+#undef NORMALMATRIX_GATHER
+
+		__m128 c00 = _mm_sub_ps(_mm_mul_ps(a11, a22), _mm_mul_ps(a12, a21));
+		__m128 c01 = _mm_sub_ps(_mm_mul_ps(a12, a20), _mm_mul_ps(a10, a22));
+		__m128 c02 = _mm_sub_ps(_mm_mul_ps(a10, a21), _mm_mul_ps(a11, a20));
+		__m128 c10 = _mm_sub_ps(_mm_mul_ps(a02, a21), _mm_mul_ps(a01, a22));
+		__m128 c11 = _mm_sub_ps(_mm_mul_ps(a00, a22), _mm_mul_ps(a02, a20));
+		__m128 c12 = _mm_sub_ps(_mm_mul_ps(a01, a20), _mm_mul_ps(a00, a21));
+		__m128 c20 = _mm_sub_ps(_mm_mul_ps(a01, a12), _mm_mul_ps(a02, a11));
+		__m128 c21 = _mm_sub_ps(_mm_mul_ps(a02, a10), _mm_mul_ps(a00, a12));
+		__m128 c22 = _mm_sub_ps(_mm_mul_ps(a00, a11), _mm_mul_ps(a01, a10));
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a00, c00), _mm_mul_ps(a01, c01)), _mm_mul_ps(a02, c02));
+		__m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+		// back to AoS, the normal matrix element at (col, row) is cofactor (row, col)
+		alignas(16) float out[9][4];
+		_mm_store_ps(out[0], _mm_mul_ps(c00, invDet)); _mm_store_ps(out[1], _mm_mul_ps(c10, invDet)); _mm_store_ps(out[2], _mm_mul_ps(c20, invDet));
+		_mm_store_ps(out[3], _mm_mul_ps(c01, invDet)); _mm_store_ps(out[4], _mm_mul_ps(c11, invDet)); _mm_store_ps(out[5], _mm_mul_ps(c21, invDet));
+		_mm_store_ps(out[6], _mm_mul_ps(c02, invDet)); _mm_store_ps(out[7], _mm_mul_ps(c12, invDet)); _mm_store_ps(out[8], _mm_mul_ps(c22, invDet));
+		for (int lane = 0; lane < 4; lane++)
+		{
+			glm::mat3& n = instances[i + lane].normalMatrix;
+			for (int col = 0; col < 3; col++)
+				for (int row = 0; row < 3; row++)
+					n[col][row] = out[col * 3 + row][lane];
+		}
+	}
+#endif
+	for (; i < count; i++)
+		computeNormalMatrix(instances[i]);
+}
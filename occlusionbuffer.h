@@ -0,0 +1,234 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_TILE_WIDTH 32 // a multiple of 4, one SSE register covers 4 pixels of a row
+#define OCCLUSION_TILE_HEIGHT 16
+#define OCCLUSION_TILES_X (OCCLUSION_WIDTH / OCCLUSION_TILE_WIDTH)
+#define OCCLUSION_TILES_Y (OCCLUSION_HEIGHT / OCCLUSION_TILE_HEIGHT)
+
+// A small depth buffer on the CPU: the nearest objects are rasterized into it as occluders and everything else is
+// tested against it, which culls hidden objects without reading anything back from the GPU. It holds 1/w, which
+// is linear across a triangle on screen and grows towards the camera, so nearer is always greater and a cleared
+// buffer (0) is infinitely far away. Occluders are rasterized tile by tile, 4 pixels of a row at once with SSE, and
+// only into pixels they cover entirely, since a query takes every written pixel as fully covered. Each tile keeps
+// the farthest value in it so most of a query is answered by the tiles alone.
+// The resolution is fixed whatever the window's size, pixels just aren't square
+class OcclusionBuffer
+{
+public:
+	unsigned int occludersDrawn = 0;
+
+	OcclusionBuffer() : depth(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 0.0f)
+	{
+		std::fill(tileFarthest, tileFarthest + OCCLUSION_TILES_X * OCCLUSION_TILES_Y, 0.0f);
+		std::fill(tileDirty, tileDirty + OCCLUSION_TILES_X * OCCLUSION_TILES_Y, false);
+	}
+
+	// starts a frame. anything closer to the eye than zNear is clipped away on the GPU, so it can't occlude here
+	void clear(const glm::mat4& viewProjection, float zNear)
+	{
+		this->viewProjection = viewProjection;
+		this->zNear = zNear;
+		std::fill(depth.begin(), depth.end(), 0.0f);
+		std::fill(tileFarthest, tileFarthest + OCCLUSION_TILES_X * OCCLUSION_TILES_Y, 0.0f);
+		occludersDrawn = 0;
+	}
+
+	// the unit cube (-0.5 to 0.5) through model, i.e. one of the scene's cubes. a box crossing the near plane is
+	// left out entirely rather than clipped, that only ever makes the culling more conservative. it goes in as its
+	// outline on screen at the depth of its farthest corner: moving each face's triangles in by half a pixel would
+	// leave a crack along every edge they share, and a query spanning one would never be occluded
+	void drawBox(const glm::mat4& model)
+	{
+		glm::mat4 transform = viewProjection * model;
+		glm::vec2 corners[8];
+		float farthest = 0.0f;
+		for (int i = 0; i < 8; i++)
+		{
+			glm::vec4 clip = transform * glm::vec4(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f, 1.0f);
+			if (clip.w < zNear) return;
+			glm::vec3 screen = toScreen(clip);
+			corners[i] = glm::vec2(screen);
+			farthest = i == 0 ? screen.z : std::min(farthest, screen.z);
+		}
+
+		// the outline is the corners' convex hull, counter-clockwise (monotone chain: lower half left to right, upper
+		// half back), collinear points dropped
+		std::sort(corners, corners + 8, [](const glm::vec2& a, const glm::vec2& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+		glm::vec2 hull[16];
+		int count = 0;
+		for (int pass = 0; pass < 2; pass++)
+		{
+			int start = count;
+			for (int j = 0; j < 8; j++)
+			{
+				const glm::vec2& corner = corners[pass == 0 ? j : 7 - j];
+				while (count >= start + 2 && cross(hull[count - 2], hull[count - 1], corner) <= 0.0f) count--;
+				hull[count++] = corner;
+			}
+			count--; // each half ends where the other starts
+		}
+		if (count >= 3) drawConvex(hull, count, farthest);
+	}
+
+	// after the last occluder, before the first query
+	void finish()
+	{
+		for (int tile = 0; tile < OCCLUSION_TILES_X * OCCLUSION_TILES_Y; tile++)
+		{
+			if (!tileDirty[tile]) continue;
+			tileDirty[tile] = false;
+			int x0 = (tile % OCCLUSION_TILES_X) * OCCLUSION_TILE_WIDTH, y0 = (tile / OCCLUSION_TILES_X) * OCCLUSION_TILE_HEIGHT;
+			float farthest = depth[y0 * OCCLUSION_WIDTH + x0];
+			for (int y = y0; y < y0 + OCCLUSION_TILE_HEIGHT; y++)
+				for (int x = x0; x < x0 + OCCLUSION_TILE_WIDTH; x++) farthest = std::min(farthest, depth[y * OCCLUSION_WIDTH + x]);
+			tileFarthest[tile] = farthest;
+		}
+	}
+
+	// a world space box as center and half extent. occluded when every pixel it could touch already holds
+	// something nearer than its nearest corner
+	bool isOccluded(const glm::vec3& center, const glm::vec3& extent) const
+	{
+		float minX = (float)OCCLUSION_WIDTH, minY = (float)OCCLUSION_HEIGHT, maxX = 0.0f, maxY = 0.0f, nearest = 0.0f;
+		for (int i = 0; i < 8; i++)
+		{
+			glm::vec3 corner = center + extent * glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+			glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+			if (clip.w < zNear) return false;
+			glm::vec3 screen = toScreen(clip);
+			minX = std::min(minX, screen.x);
+			minY = std::min(minY, screen.y);
+			maxX = std::max(maxX, screen.x);
+			maxY = std::max(maxY, screen.y);
+			nearest = std::max(nearest, screen.z);
+		}
+		// every pixel the box overlaps at all, not just the ones whose centers it covers
+		int x0 = std::max((int)std::floor(minX), 0), y0 = std::max((int)std::floor(minY), 0);
+		int x1 = std::min((int)std::ceil(maxX), OCCLUSION_WIDTH), y1 = std::min((int)std::ceil(maxY), OCCLUSION_HEIGHT);
+		if (x0 >= x1 || y0 >= y1) return false;
+
+		for (int ty = y0 / OCCLUSION_TILE_HEIGHT; ty <= (y1 - 1) / OCCLUSION_TILE_HEIGHT; ty++)
+		{
+			for (int tx = x0 / OCCLUSION_TILE_WIDTH; tx <= (x1 - 1) / OCCLUSION_TILE_WIDTH; tx++)
+			{
+				// the whole tile is nearer than the box, so is the part of the box inside it
+				if (nearest < tileFarthest[ty * OCCLUSION_TILES_X + tx]) continue;
+				int rowStart = std::max(y0, ty * OCCLUSION_TILE_HEIGHT), rowEnd = std::min(y1, (ty + 1) * OCCLUSION_TILE_HEIGHT);
+				int columnStart = std::max(x0, tx * OCCLUSION_TILE_WIDTH), columnEnd = std::min(x1, (tx + 1) * OCCLUSION_TILE_WIDTH);
+				for (int y = rowStart; y < rowEnd; y++)
+				{
+					const float* row = &depth[y * OCCLUSION_WIDTH];
+					int x = columnStart;
+#ifdef OCCLUSION_SSE
+					__m128 boxDepth = _mm_set1_ps(nearest);
+					for (; x + 4 <= columnEnd; x += 4)
+						if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), boxDepth))) return false;
+#endif
+					for (; x < columnEnd; x++)
+						if (row[x] <= nearest) return false;
+				}
+			}
+		}
+		return true;
+	}
+
+private:
+	std::vector<float> depth;
+	float tileFarthest[OCCLUSION_TILES_X * OCCLUSION_TILES_Y];
+	bool tileDirty[OCCLUSION_TILES_X * OCCLUSION_TILES_Y];
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+	float zNear = 0.1f;
+
+	// pixel coordinates with y up, the way NDC has it so windings don't flip, and 1/w
+	static glm::vec3 toScreen(const glm::vec4& clip)
+	{
+		float inverseW = 1.0f / clip.w;
+		return glm::vec3((clip.x * inverseW * 0.5f + 0.5f) * OCCLUSION_WIDTH, (clip.y * inverseW * 0.5f + 0.5f) * OCCLUSION_HEIGHT, inverseW);
+	}
+
+	// twice the signed area of abc, positive when counter-clockwise
+	static float cross(const glm::vec2& a, const glm::vec2& b, const glm::vec2& c)
+	{
+		return (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+	}
+
+	// a counter-clockwise convex polygon of up to 8 points at depth z, into every pixel it covers entirely
+	void drawConvex(const glm::vec2* points, int count, float z)
+	{
+		float minX = points[0].x, minY = points[0].y, maxX = points[0].x, maxY = points[0].y;
+		for (int i = 1; i < count; i++)
+		{
+			minX = std::min(minX, points[i].x);
+			minY = std::min(minY, points[i].y);
+			maxX = std::max(maxX, points[i].x);
+			maxY = std::max(maxY, points[i].y);
+		}
+		int x0 = std::max((int)std::floor(minX), 0), y0 = std::max((int)std::floor(minY), 0);
+		int x1 = std::min((int)std::ceil(maxX), OCCLUSION_WIDTH), y1 = std::min((int)std::ceil(maxY), OCCLUSION_HEIGHT);
+		if (x0 >= x1 || y0 >= y1) return;
+		occludersDrawn++;
+
+		// edge functions e = A x + B y + C, positive inside. the pixel's corner furthest out along an edge's normal is
+		// half a pixel from its center in x and y, (|A| + |B|) / 2 lower, so moving C down by that much makes a
+		// center passing every edge mean the whole pixel does
+		float edgeA[8], edgeB[8], edgeC[8];
+		for (int i = 0; i < count; i++)
+		{
+			const glm::vec2& p = points[i];
+			const glm::vec2& q = points[(i + 1) % count];
+			edgeA[i] = p.y - q.y;
+			edgeB[i] = q.x - p.x;
+			edgeC[i] = p.x * q.y - p.y * q.x - 0.5f * (std::abs(edgeA[i]) + std::abs(edgeB[i]));
+		}
+
+		for (int ty = y0 / OCCLUSION_TILE_HEIGHT; ty <= (y1 - 1) / OCCLUSION_TILE_HEIGHT; ty++)
+		{
+			for (int tx = x0 / OCCLUSION_TILE_WIDTH; tx <= (x1 - 1) / OCCLUSION_TILE_WIDTH; tx++)
+			{
+				tileDirty[ty * OCCLUSION_TILES_X + tx] = true;
+				int rowStart = std::max(y0, ty * OCCLUSION_TILE_HEIGHT), rowEnd = std::min(y1, (ty + 1) * OCCLUSION_TILE_HEIGHT);
+				// aligned down to 4, the extra pixels are still inside the tile and fail the edge tests
+				int columnStart = std::max(x0, tx * OCCLUSION_TILE_WIDTH) & ~3, columnEnd = std::min(x1, (tx + 1) * OCCLUSION_TILE_WIDTH);
+				for (int y = rowStart; y < rowEnd; y++)
+				{
+					float* row = &depth[y * OCCLUSION_WIDTH];
+					float py = y + 0.5f;
+#ifdef OCCLUSION_SSE
+					__m128 rowC[8];
+					for (int i = 0; i < count; i++) rowC[i] = _mm_set1_ps(edgeB[i] * py + edgeC[i]);
+					__m128 depthZ = _mm_set1_ps(z);
+					__m128 zero = _mm_setzero_ps();
+					for (int x = columnStart; x < columnEnd; x += 4)
+					{
+						__m128 px = _mm_setr_ps(x + 0.5f, x + 1.5f, x + 2.5f, x + 3.5f);
+						__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[0]), px), rowC[0]), zero);
+						for (int i = 1; i < count; i++)
+							inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[i]), px), rowC[i]), zero));
+						__m128 old = _mm_loadu_ps(row + x);
+						_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_max_ps(old, depthZ)), _mm_andnot_ps(inside, old)));
+					}
+#else
+					for (int x = columnStart; x < columnEnd; x++)
+					{
+						float px = x + 0.5f;
+						bool inside = true;
+						for (int i = 0; i < count && inside; i++) inside = edgeA[i] * px + edgeB[i] * py + edgeC[i] >= 0.0f;
+						if (inside) row[x] = std::max(row[x], z);
+					}
+#endif
+				}
+			}
+		}
+	}
+};
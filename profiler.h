@@ -0,0 +1,278 @@
+#pragma once
+#include <glad/glad.h>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+
+#include "vendor/imgui/imgui.h"
+
+// results are read PROFILER_LATENCY frames after they were issued, by then the GPU is done with them and
+// reading never stalls the pipeline
+#define PROFILER_LATENCY 3
+#define PROFILER_MAX_SCOPES 64
+#define PROFILER_HISTORY 120
+
+// Nested CPU and GPU timings for named scopes. Every scope records a CPU time with std::chrono and a pair of
+// GL_TIMESTAMP queries; timestamps rather than GL_TIME_ELAPSED because elapsed queries can't nest and the
+// timeline needs absolute start times anyway. Each frame owns its own set of queries in a ring of
+// PROFILER_LATENCY frames.
+class Profiler
+{
+public:
+	struct Record
+	{
+		const char* name;
+		int depth;
+		float cpuStart, cpuTime, gpuStart, gpuTime; // ms, starts are relative to the frame's start
+	};
+
+	struct FrameTiming
+	{
+		int frame;
+		float cpuTime, gpuTime;
+	};
+
+	// the last frame whose GPU results came back, what the timeline shows
+	std::vector<Record> lastFrame;
+	float lastFrameCpu = 0.0f, lastFrameGpu = 0.0f;
+	unsigned int stalls = 0; // frames where the results weren't ready yet and had to be waited on
+
+	// when set, every collected frame's totals are kept in timings, oldest first
+	bool keepTimings = false;
+	std::vector<FrameTiming> timings;
+
+	Profiler()
+	{
+		glGenQueries(PROFILER_LATENCY * (PROFILER_MAX_SCOPES + 1) * 2, &queries[0][0]);
+	}
+
+	void beginFrame()
+	{
+		frameIndex = (frameIndex + 1) % PROFILER_LATENCY;
+		FrameSlot& slot = frames[frameIndex];
+		if (slot.used) collect(slot);
+
+		slot.used = true;
+		slot.frame = frameNumber++;
+		slot.records.clear();
+		slot.cpuFrameStart = std::chrono::high_resolution_clock::now();
+		glQueryCounter(queries[frameIndex][0], GL_TIMESTAMP);
+		depth = 0;
+	}
+
+	void endFrame()
+	{
+		FrameSlot& slot = frames[frameIndex];
+		slot.cpuFrameTime = msSince(slot.cpuFrameStart);
+		glQueryCounter(queries[frameIndex][1], GL_TIMESTAMP);
+	}
+
+	// returns a handle for end(), -1 once the frame is out of scope slots
+	int begin(const char* name)
+	{
+		FrameSlot& slot = frames[frameIndex];
+		if (slot.records.size() >= PROFILER_MAX_SCOPES) return -1;
+		int scope = (int)slot.records.size();
+		slot.records.push_back({ name, depth++, msSince(slot.cpuFrameStart), 0.0f, 0.0f, 0.0f });
+		glQueryCounter(queries[frameIndex][2 + scope * 2], GL_TIMESTAMP);
+		return scope;
+	}
+
+	void end(int scope)
+	{
+		depth--;
+		if (scope < 0) return;
+		FrameSlot& slot = frames[frameIndex];
+		slot.records[scope].cpuTime = msSince(slot.cpuFrameStart) - slot.records[scope].cpuStart;
+		glQueryCounter(queries[frameIndex][3 + scope * 2], GL_TIMESTAMP);
+	}
+
+	// waits for and collects every frame still in flight, for when the last frames' results are needed
+	void flush()
+	{
+		for (int i = 1; i <= PROFILER_LATENCY; i++)
+		{
+			FrameSlot& slot = frames[(frameIndex + i) % PROFILER_LATENCY];
+			if (slot.used) collect(slot);
+			slot.used = false;
+		}
+	}
+
+	// history plots per scope and a CPU / GPU timeline of the last finished frame, nested scopes below their parent
+	void drawImGui()
+	{
+		ImGui::Begin("Profiler");
+		ImGui::Text("Frame: %.3f ms CPU, %.3f ms GPU (%u stalls)", lastFrameCpu, lastFrameGpu, stalls);
+
+		float frameLength = std::max(std::max(lastFrameCpu, lastFrameGpu), 0.001f);
+		drawTimeline("CPU", false, frameLength);
+		drawTimeline("GPU", true, frameLength);
+
+		char overlay[64];
+		float plotWidth = ImGui::GetContentRegionAvail().x * 0.5f - 4.0f;
+		for (const Record& record : lastFrame)
+		{
+			History& history = histories[record.name];
+			ImGui::PushID(record.name);
+			snprintf(overlay, sizeof(overlay), "%s cpu %.3f", record.name, record.cpuTime);
+			ImGui::PlotHistogram("##cpu", history.cpu, PROFILER_HISTORY, history.next, overlay, 0.0f, history.peak, ImVec2(plotWidth, 40.0f));
+			ImGui::SameLine();
+			snprintf(overlay, sizeof(overlay), "gpu %.3f", record.gpuTime);
+			ImGui::PlotHistogram("##gpu", history.gpu, PROFILER_HISTORY, history.next, overlay, 0.0f, history.peak, ImVec2(plotWidth, 40.0f));
+			ImGui::PopID();
+		}
+		ImGui::End();
+	}
+
+	void destroy()
+	{
+		glDeleteQueries(PROFILER_LATENCY * (PROFILER_MAX_SCOPES + 1) * 2, &queries[0][0]);
+	}
+
+private:
+	struct FrameSlot
+	{
+		bool used = false;
+		int frame = 0;
+		std::vector<Record> records;
+		std::chrono::high_resolution_clock::time_point cpuFrameStart;
+		float cpuFrameTime = 0.0f;
+	};
+
+	struct History
+	{
+		float cpu[PROFILER_HISTORY] = {};
+		float gpu[PROFILER_HISTORY] = {};
+		int next = 0;
+		float peak = 0.0f;
+	};
+
+	// [frame][0, 1] are the frame's start and end, then a begin/end pair per scope
+	unsigned int queries[PROFILER_LATENCY][(PROFILER_MAX_SCOPES + 1) * 2];
+	FrameSlot frames[PROFILER_LATENCY];
+	std::map<std::string, History> histories;
+	int frameIndex = 0;
+	int frameNumber = 0;
+	int depth = 0;
+
+	static float msSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	void collect(FrameSlot& slot)
+	{
+		unsigned int* frameQueries = queries[&slot - frames];
+		GLint available = 0;
+		glGetQueryObjectiv(frameQueries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) stalls++;
+
+		GLuint64 frameStart, frameEnd;
+		glGetQueryObjectui64v(frameQueries[0], GL_QUERY_RESULT, &frameStart);
+		glGetQueryObjectui64v(frameQueries[1], GL_QUERY_RESULT, &frameEnd);
+		lastFrameGpu = (frameEnd - frameStart) / 1e6f;
+		lastFrameCpu = slot.cpuFrameTime;
+
+		for (size_t i = 0; i < slot.records.size(); i++)
+		{
+			GLuint64 start, end;
+			glGetQueryObjectui64v(frameQueries[2 + i * 2], GL_QUERY_RESULT, &start);
+			glGetQueryObjectui64v(frameQueries[3 + i * 2], GL_QUERY_RESULT, &end);
+			Record& record = slot.records[i];
+			record.gpuStart = (start - frameStart) / 1e6f;
+			record.gpuTime = (end - start) / 1e6f;
+
+			History& history = histories[record.name];
+			history.cpu[history.next] = record.cpuTime;
+			history.gpu[history.next] = record.gpuTime;
+			history.next = (history.next + 1) % PROFILER_HISTORY;
+			history.peak = std::max(history.peak * 0.99f, std::max(record.cpuTime, record.gpuTime));
+		}
+		lastFrame = slot.records;
+		if (keepTimings) timings.push_back({ slot.frame, lastFrameCpu, lastFrameGpu });
+	}
+
+	void drawTimeline(const char* label, bool gpu, float frameLength)
+	{
+		const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+		int rows = 1;
+		for (const Record& record : lastFrame) rows = std::max(rows, record.depth + 1);
+
+		ImGui::Text("%s", label);
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		ImVec2 origin = ImGui::GetCursorScreenPos();
+		float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+		drawList->AddRectFilled(origin, ImVec2(origin.x + width, origin.y + rows * rowHeight), IM_COL32(30, 30, 30, 255));
+
+		for (const Record& record : lastFrame)
+		{
+			float start = gpu ? record.gpuStart : record.cpuStart;
+			float time = gpu ? record.gpuTime : record.cpuTime;
+			ImVec2 min(origin.x + start / frameLength * width, origin.y + record.depth * rowHeight);
+			ImVec2 max(std::max(min.x + 1.0f, origin.x + (start + time) / frameLength * width), min.y + rowHeight - 1.0f);
+
+			// colour by name so a scope keeps its colour from frame to frame
+			unsigned int hash = (unsigned int)std::hash<std::string>()(record.name);
+			drawList->AddRectFilled(min, max, IM_COL32(80 + hash % 120, 80 + (hash >> 8) % 120, 80 + (hash >> 16) % 120, 255));
+			drawList->PushClipRect(min, max, true);
+			drawList->AddText(ImVec2(min.x + 2.0f, min.y + 2.0f), IM_COL32_WHITE, record.name);
+			drawList->PopClipRect();
+			if (ImGui::IsMouseHoveringRect(min, max))
+				ImGui::SetTooltip("%s: %.3f ms", record.name, time);
+		}
+		ImGui::Dummy(ImVec2(width, rows * rowHeight));
+	}
+};
+
+// times everything until the end of the enclosing block
+class ProfileScope
+{
+public:
+	ProfileScope(Profiler& profiler, const char* name) : profiler(profiler), scope(profiler.begin(name)) {}
+	~ProfileScope() { profiler.end(scope); }
+
+private:
+	Profiler& profiler;
+	int scope;
+};
+
+// Fragments that passed the depth test between begin() and end(), i.e. how many ran their fragment shader, with
+// GL_SAMPLES_PASSED queries in a ring of PROFILER_LATENCY like the timings, so the count is a few frames old but
+// never waited on. Only one can be counting at a time
+class SampleCounter
+{
+public:
+	GLuint64 samples = 0;
+
+	SampleCounter()
+	{
+		glGenQueries(PROFILER_LATENCY, queries);
+	}
+
+	void begin()
+	{
+		index = (index + 1) % PROFILER_LATENCY;
+		if (issued[index]) glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &samples);
+		glBeginQuery(GL_SAMPLES_PASSED, queries[index]);
+		issued[index] = true;
+	}
+
+	void end()
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+	}
+
+	void destroy()
+	{
+		glDeleteQueries(PROFILER_LATENCY, queries);
+	}
+
+private:
+	unsigned int queries[PROFILER_LATENCY];
+	bool issued[PROFILER_LATENCY] = {};
+	int index = 0;
+};
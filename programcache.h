@@ -0,0 +1,141 @@
+#pragma once
+#include <glad/glad.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "shadersource.h"
+
+// Linked programs saved to disk with glGetProgramBinary and loaded back with glProgramBinary, so a second launch
+// skips compiling and linking. Entries are keyed by a hash of both sources plus the GL vendor, renderer and version
+// strings: a driver update changes the key, and so does any edit to a shader. A binary the driver rejects anyway
+// just counts as a miss and the program is built from source again. Old entries are never cleaned up; deleting
+// the directory is always safe
+class ProgramCache
+{
+public:
+    bool enabled = true;
+    std::string directory = "shadercache";
+    unsigned int hits = 0, misses = 0;
+
+    // 64 bit FNV-1a over both stages and the driver, as the file name of the entry. a stage hashes the same however
+    // it's split into strings
+    std::string key(const ShaderSource& vertex, const ShaderSource& fragment)
+    {
+        if (driver.empty())
+        {
+            for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+            {
+                const char* value = (const char*)glGetString(name);
+                driver += value ? value : "";
+                driver += '\n';
+            }
+        }
+        unsigned long long hash = 14695981039346656037ull;
+        auto add = [&hash](const char* data, size_t length)
+        {
+            for (size_t i = 0; i < length; i++) hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+        };
+        // the separator keeps "ab" + "c" apart from "a" + "bc"
+        auto separate = [&hash]() { hash = (hash ^ 0xFF) * 1099511628211ull; };
+        add(driver.data(), driver.size());
+        separate();
+        for (const ShaderSource* stage : { &vertex, &fragment })
+        {
+            for (GLsizei i = 0; i < stage->count(); i++) add(stage->strings[i], (size_t)stage->lengths[i]);
+            separate();
+        }
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", hash);
+        return name;
+    }
+
+    // a linked program from the cache, or 0 when there's no usable entry (counted as a miss either way, so misses
+    // is the number of programs that had to be compiled)
+    unsigned int load(const std::string& key)
+    {
+        std::ifstream file;
+        if (enabled && supported()) file.open(path(key), std::ios::binary | std::ios::ate);
+        if (!file.is_open())
+        {
+            misses++;
+            return 0;
+        }
+        size_t size = (size_t)file.tellg();
+        GLenum format = 0;
+        std::vector<char> binary(size > sizeof(format) ? size - sizeof(format) : 0);
+        file.seekg(0);
+        file.read((char*)&format, sizeof(format));
+        file.read(binary.data(), binary.size());
+
+        unsigned int program = glCreateProgram();
+        glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+        int success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glDeleteProgram(program);
+            misses++;
+            return 0;
+        }
+        hits++;
+        return program;
+    }
+
+    // call before linking a program that's going to be stored
+    void prepare(unsigned int program)
+    {
+        if (enabled && supported()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    void store(const std::string& key, unsigned int program)
+    {
+        if (!enabled || !supported()) return;
+        int length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+        std::ofstream file(path(key), std::ios::binary);
+        file.write((const char*)&format, sizeof(format));
+        file.write(binary.data(), binary.size());
+        if (!file) std::cout << "ERROR::PROGRAMCACHE::FILE_NOT_WRITTEN: " << path(key) << std::endl;
+    }
+
+private:
+    std::string driver;
+    int formats = -1;
+
+    // drivers are allowed to support no binary formats at all
+    bool supported()
+    {
+        if (formats < 0) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    std::string path(const std::string& key) const
+    {
+        return directory + "/" + key + ".bin";
+    }
+};
+
+// the cache every Shader builds through
+inline ProgramCache& programCache()
+{
+    static ProgramCache cache;
+    return cache;
+}
@@ -0,0 +1,157 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include "renderstate.h"
+
+struct SortEntry
+{
+	uint64_t key;
+	uint32_t index; // of whatever is being sorted
+};
+
+// Sorts by key, least significant byte first. All 8 histograms come from one pass over the keys, and a byte that's
+// the same in every key (the unused pass bits, mostly) costs nothing. Stable, so draws with equal keys keep their
+// submission order
+inline void radixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+{
+	size_t count = entries.size();
+	scratch.resize(count);
+	uint32_t histograms[8][256] = {};
+	for (const SortEntry& entry : entries)
+		for (int digit = 0; digit < 8; digit++) histograms[digit][(entry.key >> (digit * 8)) & 0xFF]++;
+
+	SortEntry* source = entries.data();
+	SortEntry* destination = scratch.data();
+	for (int digit = 0; digit < 8; digit++)
+	{
+		uint32_t* histogram = histograms[digit];
+		if (count == 0 || histogram[(source[0].key >> (digit * 8)) & 0xFF] == count) continue;
+		uint32_t offset = 0;
+		for (int bucket = 0; bucket < 256; bucket++)
+		{
+			uint32_t bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+		for (size_t i = 0; i < count; i++)
+			destination[histogram[(source[i].key >> (digit * 8)) & 0xFF]++] = source[i];
+		std::swap(source, destination);
+	}
+	if (source != entries.data()) memcpy(entries.data(), source, count * sizeof(SortEntry));
+}
+
+// a view space depth as 32 bits that sort the same way the floats do (depths behind the camera clamp to 0)
+inline uint32_t depthBits(float depth)
+{
+	if (!(depth > 0.0f)) return 0;
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits;
+}
+
+// what one draw needs: program, vertex array, the material's two textures (units 0 and 1, 0 for none) and the
+// instances of the indexed mesh to draw. with drawCount set it's a glMultiDrawElementsIndirect of that many
+// commands at indirectOffset in indirectBuffer instead, and indexCount and the instances are unused. a countBuffer
+// on top makes drawCount the most it draws, the real count is whatever the GPU left in its first 4 bytes
+struct DrawCommand
+{
+	unsigned int program = 0, vertexArray = 0;
+	unsigned int diffuse = 0, specular = 0;
+	int indexCount = 0;
+	unsigned int firstInstance = 0, instanceCount = 0;
+	unsigned int indirectBuffer = 0, indirectOffset = 0, drawCount = 0;
+	unsigned int countBuffer = 0;
+};
+
+// Draws are submitted with a 64 bit key, sorted once per frame and executed pass by pass. Opaque keys put the
+// state first so a pass changes program and material as rarely as possible, with depth front to back inside each
+// state so early Z rejects the most. Transparent keys put the depth (back to front) ahead of the state since the
+// blend order matters more than the state changes
+//   opaque:      pass:4 | program:12 | material:16 | depth:32
+//   transparent: pass:4 | ~depth:32  | program:12 | material:16
+class RenderQueue
+{
+public:
+	// last execute()'s draw calls (a multi-draw counts once) and the state changes between them
+	unsigned int draws = 0, programChanges = 0, vertexArrayChanges = 0, materialChanges = 0;
+
+	// depth comes from depthBits()
+	static uint64_t opaqueKey(unsigned int pass, unsigned int program, unsigned int material, uint32_t depth)
+	{
+		return ((uint64_t)(pass & 0xF) << 60) | ((uint64_t)(program & 0xFFF) << 48) | ((uint64_t)(material & 0xFFFF) << 32) | depth;
+	}
+
+	static uint64_t transparentKey(unsigned int pass, unsigned int program, unsigned int material, uint32_t depth)
+	{
+		return ((uint64_t)(pass & 0xF) << 60) | ((uint64_t)(~depth) << 28) | ((uint64_t)(program & 0xFFF) << 16) | (material & 0xFFFF);
+	}
+
+	void clear()
+	{
+		entries.clear();
+		commands.clear();
+		draws = programChanges = vertexArrayChanges = materialChanges = 0;
+	}
+
+	void submit(uint64_t key, const DrawCommand& command)
+	{
+		entries.push_back({ key, (uint32_t)commands.size() });
+		commands.push_back(command);
+	}
+
+	size_t size() const { return commands.size(); }
+
+	void sort()
+	{
+		radixSort(entries, scratch);
+	}
+
+	// draws everything submitted for one pass, in key order. sort() first
+	void execute(unsigned int pass)
+	{
+		const DrawCommand* previous = NULL;
+		for (const SortEntry& entry : entries)
+		{
+			if ((entry.key >> 60) != pass) continue;
+			const DrawCommand& command = commands[entry.index];
+			if (!previous || previous->program != command.program)
+			{
+				renderState().useProgram(command.program);
+				programChanges++;
+			}
+			if (!previous || previous->vertexArray != command.vertexArray)
+			{
+				renderState().bindVertexArray(command.vertexArray);
+				vertexArrayChanges++;
+			}
+			if (!previous || previous->diffuse != command.diffuse || previous->specular != command.specular)
+			{
+				if (command.diffuse) renderState().bindTexture(0, command.diffuse);
+				if (command.specular) renderState().bindTexture(1, command.specular);
+				materialChanges++;
+			}
+			if (command.drawCount > 0 && command.countBuffer)
+			{
+				renderState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, command.indirectBuffer);
+				renderState().bindBuffer(GL_PARAMETER_BUFFER, command.countBuffer);
+				glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(size_t)command.indirectOffset, 0, command.drawCount, 0);
+			}
+			else if (command.drawCount > 0)
+			{
+				renderState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, command.indirectBuffer);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(size_t)command.indirectOffset, command.drawCount, 0);
+			}
+			else glDrawElementsInstancedBaseInstance(GL_TRIANGLES, command.indexCount, GL_UNSIGNED_INT, (void*)0, command.instanceCount, command.firstInstance);
+			draws++;
+			previous = &command;
+		}
+	}
+
+private:
+	std::vector<SortEntry> entries, scratch;
+	std::vector<DrawCommand> commands;
+};
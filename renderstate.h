@@ -0,0 +1,212 @@
+#pragma once
+#include <glad/glad.h>
+
+#define RENDERSTATE_TEXTURE_UNITS 16
+// the unit textures are bound to just to create or fill them, so that never disturbs what the draws sample
+#define RENDERSTATE_SCRATCH_UNIT (RENDERSTATE_TEXTURE_UNITS - 1)
+#define RENDERSTATE_UNKNOWN 0xFFFFFFFFu
+
+// Shadows the GL state the renderer sets every frame, so setting what's already set costs a compare instead of a
+// driver call. Everything in the tree binds through here; anything that changes this state behind its back has to
+// call invalidate() afterwards (the ImGui backend restores what it touches, so it doesn't). Objects are deleted
+// through here too, GL quietly unbinds a deleted object and its name can come back from the next glGen*.
+// GL_ELEMENT_ARRAY_BUFFER isn't tracked, it belongs to the bound vertex array rather than the context
+class RenderState
+{
+public:
+	// calls that went to the driver and calls that didn't have to, reset once per frame
+	unsigned int issued = 0, skipped = 0;
+
+	RenderState()
+	{
+		invalidate();
+	}
+
+	// forget everything, the next call for each piece of state goes to the driver
+	void invalidate()
+	{
+		program = vertexArray = activeUnit = drawFramebuffer = readFramebuffer = RENDERSTATE_UNKNOWN;
+		blendSource = blendDestination = cullMode = depthFunction = depthWrites = colorWrites = RENDERSTATE_UNKNOWN;
+		for (unsigned int& buffer : buffers) buffer = RENDERSTATE_UNKNOWN;
+		for (unsigned int& texture : textures) texture = RENDERSTATE_UNKNOWN;
+		for (unsigned int& capability : capabilities) capability = RENDERSTATE_UNKNOWN;
+	}
+
+	void resetCounters()
+	{
+		issued = skipped = 0;
+	}
+
+	void useProgram(unsigned int id)
+	{
+		if (set(program, id)) glUseProgram(id);
+	}
+
+	void bindVertexArray(unsigned int id)
+	{
+		if (set(vertexArray, id)) glBindVertexArray(id);
+	}
+
+	void bindBuffer(GLenum target, unsigned int id)
+	{
+		int slot = bufferSlot(target);
+		if (slot < 0 || set(buffers[slot], id)) glBindBuffer(target, id);
+		if (slot < 0) issued++;
+	}
+
+	// indexed bindings aren't tracked, but GL also binds the buffer to the target itself
+	void bindBufferBase(GLenum target, unsigned int index, unsigned int id)
+	{
+		glBindBufferBase(target, index, id);
+		issued++;
+		int slot = bufferSlot(target);
+		if (slot >= 0) buffers[slot] = id;
+	}
+
+	// a range of the buffer on an indexed binding, untracked like bindBufferBase
+	void bindBufferRange(GLenum target, unsigned int index, unsigned int id, GLintptr offset, GLsizeiptr size)
+	{
+		glBindBufferRange(target, index, id, offset, size);
+		issued++;
+		int slot = bufferSlot(target);
+		if (slot >= 0) buffers[slot] = id;
+	}
+
+	void activeTexture(unsigned int unit)
+	{
+		if (set(activeUnit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+	}
+
+	// GL_TEXTURE_2D on the given unit, which is left active
+	void bindTexture(unsigned int unit, unsigned int id)
+	{
+		activeTexture(unit);
+		if (set(textures[unit], id)) glBindTexture(GL_TEXTURE_2D, id);
+	}
+
+	// GL_FRAMEBUFFER sets both the draw and the read binding
+	void bindFramebuffer(GLenum target, unsigned int id)
+	{
+		bool draw = target != GL_READ_FRAMEBUFFER, read = target != GL_DRAW_FRAMEBUFFER;
+		if ((draw && drawFramebuffer != id) || (read && readFramebuffer != id))
+		{
+			glBindFramebuffer(target, id);
+			issued++;
+			if (draw) drawFramebuffer = id;
+			if (read) readFramebuffer = id;
+		}
+		else skipped++;
+	}
+
+	void enable(GLenum capability)
+	{
+		setCapability(capability, true);
+	}
+
+	void disable(GLenum capability)
+	{
+		setCapability(capability, false);
+	}
+
+	void blendFunc(GLenum source, GLenum destination)
+	{
+		if (blendSource == source && blendDestination == destination)
+		{
+			skipped++;
+			return;
+		}
+		blendSource = source;
+		blendDestination = destination;
+		glBlendFunc(source, destination);
+		issued++;
+	}
+
+	void cullFace(GLenum mode)
+	{
+		if (set(cullMode, mode)) glCullFace(mode);
+	}
+
+	void depthFunc(GLenum function)
+	{
+		if (set(depthFunction, function)) glDepthFunc(function);
+	}
+
+	void depthMask(bool write)
+	{
+		if (set(depthWrites, write)) glDepthMask(write);
+	}
+
+	// all four channels together, nothing here masks them one by one
+	void colorMask(bool write)
+	{
+		if (set(colorWrites, write)) glColorMask(write, write, write, write);
+	}
+
+	void deleteProgram(unsigned int id)
+	{
+		if (program == id) program = RENDERSTATE_UNKNOWN;
+		glDeleteProgram(id);
+	}
+
+	void deleteBuffers(int count, const unsigned int* ids)
+	{
+		for (int i = 0; i < count; i++)
+			for (unsigned int& buffer : buffers)
+				if (buffer == ids[i]) buffer = 0;
+		glDeleteBuffers(count, ids);
+	}
+
+	void deleteTextures(int count, const unsigned int* ids)
+	{
+		for (int i = 0; i < count; i++)
+			for (unsigned int& texture : textures)
+				if (texture == ids[i]) texture = 0;
+		glDeleteTextures(count, ids);
+	}
+
+private:
+	unsigned int program, vertexArray, activeUnit, drawFramebuffer, readFramebuffer;
+	unsigned int blendSource, blendDestination, cullMode, depthFunction, depthWrites, colorWrites;
+	unsigned int buffers[6];
+	unsigned int textures[RENDERSTATE_TEXTURE_UNITS];
+	unsigned int capabilities[5]; // 0 or 1 once known
+
+	bool set(unsigned int& shadow, unsigned int value)
+	{
+		if (shadow == value)
+		{
+			skipped++;
+			return false;
+		}
+		shadow = value;
+		issued++;
+		return true;
+	}
+
+	static int bufferSlot(GLenum target)
+	{
+		static const GLenum targets[] = { GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER, GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_DRAW_INDIRECT_BUFFER };
+		for (int i = 0; i < 6; i++)
+			if (targets[i] == target) return i;
+		return -1;
+	}
+
+	void setCapability(GLenum capability, bool on)
+	{
+		static const GLenum tracked[] = { GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_STENCIL_TEST, GL_SCISSOR_TEST };
+		int slot = -1;
+		for (int i = 0; i < 5; i++)
+			if (tracked[i] == capability) slot = i;
+		if (slot >= 0 && !set(capabilities[slot], on ? 1 : 0)) return;
+		if (slot < 0) issued++;
+		if (on) glEnable(capability);
+		else glDisable(capability);
+	}
+};
+
+// the one context's state, everything binds through this
+inline RenderState& renderState()
+{
+	static RenderState state;
+	return state;
+}
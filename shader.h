@@ -4,110 +4,161 @@
 #include <glad/glad.h>
 
 #include <string>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+#include <unordered_map>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "assetpack.h"
+#include "programcache.h"
+#include "shadersource.h"
+#include "renderstate.h"
+
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
-    Shader(const char* vertexPath, const char* fragmentPath)
-    {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch (std::ifstream::failure& e)
+    // kept so ShaderWatcher can rebuild the same variant
+    std::string vertexPath, fragmentPath;
+    std::vector<std::string> defines;
+    // every file the sources were expanded from, the stages' own files and all their includes
+    std::vector<std::string> files;
+    // constructor generates the shader on the fly. defines are "NAME" or "NAME value", see ShaderPermutations
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = {})
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), defines(defines)
+    {
+        // 1. expand the vertex/fragment source code, read through the asset pack when it has the files
+        ShaderSource vertexCode, fragmentCode;
+        preprocess(vertexPath, defines, vertexCode, files);
+        preprocess(fragmentPath, defines, fragmentCode, files);
+        // 2. compile and link
+        if (!build(vertexCode, fragmentCode, ID)) printFiles();
+        // 3. resolve every active uniform's location once so the setters never have to ask the driver
+        cacheUniformLocations();
+    }
+    // builds a new program from already expanded sources and swaps it in only if it compiled and linked, otherwise
+    // the old program stays. the uniform locations are re-cached, but uniform values set on the old program are lost
+    bool reload(const ShaderSource& vertexCode, const ShaderSource& fragmentCode, const std::vector<std::string>& sourceFiles)
+    {
+        unsigned int program;
+        if (!build(vertexCode, fragmentCode, program))
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            glDeleteProgram(program);
+            files = sourceFiles;
+            printFiles();
+            return false;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        renderState().deleteProgram(ID);
+        ID = program;
+        files = sourceFiles;
+        cacheUniformLocations();
+        return true;
+    }
+
+    // expands #include "file" (relative to the including file, each file at most once per stage) and adds a
+    // #define for every entry of defines right after #version. #line directives keep the compiler's error
+    // messages pointing at the right line, with the file's index in files as the source string number. code is
+    // spans of the files in between those lines, see ShaderSource.
+    // looseFiles skips the asset pack, ShaderWatcher wants the files being edited
+    static bool preprocess(const std::string& path, const std::vector<std::string>& defines, ShaderSource& code, std::vector<std::string>& files, bool looseFiles = false)
+    {
+        std::vector<std::string> included;
+        code.clear();
+        return expand(path, defines, code, files, included, looseFiles, 0);
     }
     // activate the shader
     void use()
     {
-        glUseProgram(ID);
+        renderState().useProgram(ID);
     }
-    // utility uniform functions
+    // returns the location cached at link time, or -1 if the program has no such active uniform.
+    // resolve these once outside the render loop and pass them to the location based setters below
+    int getUniformLocation(const std::string& name) const
+    {
+        if (!cachedLocations) return queryLocation(name);
+        auto it = uniformLocations.find(name);
+        if (it == uniformLocations.end()) return -1;
+        return it->second;
+    }
+
+    // utility uniform functions (by name, looked up in the cache)
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        setBool(getUniformLocation(name), value);
     }
 
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        setInt(getUniformLocation(name), value);
     }
 
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        setFloat(getUniformLocation(name), value);
     }
 
     void setVec3(const std::string& name, float value1, float value2, float value3) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), value1, value2, value3);
+        setVec3(getUniformLocation(name), value1, value2, value3);
     }
 
     void setVec3(const std::string& name, glm::vec3 vec) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), vec.x, vec.y, vec.z);
+        setVec3(getUniformLocation(name), vec);
     }
 
     void setMat4(const std::string& name, glm::mat4 matrix) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(matrix));
+        setMat4(getUniformLocation(name), matrix);
     }
 
-private:
-    // utility function for checking shader compilation/linking errors.
-    void checkCompileErrors(unsigned int shader, std::string type)
+    // utility uniform functions (by location, for the hot path)
+    void setBool(int location, bool value) const
+    {
+        uniformWrites++;
+        glUniform1i(location, (int)value);
+    }
+
+    void setInt(int location, int value) const
+    {
+        uniformWrites++;
+        glUniform1i(location, value);
+    }
+
+    void setFloat(int location, float value) const
+    {
+        uniformWrites++;
+        glUniform1f(location, value);
+    }
+
+    void setVec3(int location, float value1, float value2, float value3) const
+    {
+        uniformWrites++;
+        glUniform3f(location, value1, value2, value3);
+    }
+
+    void setVec3(int location, glm::vec3 vec) const
+    {
+        uniformWrites++;
+        glUniform3f(location, vec.x, vec.y, vec.z);
+    }
+
+    void setMat4(int location, const glm::mat4& matrix) const
+    {
+        uniformWrites++;
+        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(matrix));
+    }
+
+    // utility function for checking shader compilation/linking errors, ComputeShader uses it too
+    static bool checkCompileErrors(unsigned int shader, std::string type)
     {
         int success;
         char infoLog[1024];
@@ -129,6 +180,267 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
+    }
+
+    // driver call counters for the Debug Menu, reset them once per frame
+    mutable unsigned int uniformWrites = 0;
+    mutable unsigned int locationQueries = 0;
+    // off sends every by-name lookup to the driver the way it went before the cache, to measure the difference
+    bool cachedLocations = true;
+
+private:
+    std::unordered_map<std::string, int> uniformLocations;
+
+    // walks GL_ACTIVE_UNIFORMS and stores the location of every uniform the linker kept.
+    // struct members come back fully qualified ("pointLights[0].position"), arrays of plain types
+    // come back once as "name[0]" so every element gets registered on its own as well as "name"
+    void cacheUniformLocations()
+    {
+        uniformLocations.clear();
+        int count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+
+        for (int i = 0; i < count; i++)
+        {
+            int length = 0, size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+            std::string name(nameBuffer.data(), length);
+
+            int location = queryLocation(name);
+            if (location < 0) continue; // members of uniform blocks have no location
+
+            uniformLocations[name] = location;
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                uniformLocations[base] = location;
+                for (int element = 1; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    uniformLocations[elementName] = queryLocation(elementName);
+                }
+            }
+        }
+    }
+
+    static bool expand(const std::string& path, const std::vector<std::string>& defines, ShaderSource& code, std::vector<std::string>& files,
+        std::vector<std::string>& included, bool looseFiles, int depth)
+    {
+        if (std::find(included.begin(), included.end(), path) != included.end()) return true;
+        if (depth > 16)
+        {
+            std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP: " << path << std::endl;
+            return false;
+        }
+        included.push_back(path);
+        size_t fileIndex = std::find(files.begin(), files.end(), path) - files.begin();
+        if (fileIndex == files.size()) files.push_back(path);
+
+        // a packed file is used where it's mapped, a loose one is read into the source's own storage
+        const char* source = NULL;
+        size_t sourceSize = 0;
+        if (looseFiles)
+        {
+            std::ifstream file(path);
+            std::stringstream stream;
+            stream << file.rdbuf();
+            const std::string& text = code.own(stream.str());
+            source = text.data();
+            sourceSize = text.size();
+        }
+        else
+        {
+            AssetFile file(path);
+            if (file.mapped())
+            {
+                source = (const char*)file.data();
+                sourceSize = file.size();
+            }
+            else
+            {
+                const std::string& text = code.own(std::string((const char*)file.data(), file.size()));
+                source = text.data();
+                sourceSize = text.size();
+            }
+        }
+        if (sourceSize == 0)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return false;
+        }
+
+        bool success = true;
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        if (depth > 0) code.appendGenerated("#line 1 " + std::to_string(fileIndex) + "\n");
+        const char* end = source + sourceSize;
+        int lineNumber = 1;
+        for (const char* line = source; line < end; lineNumber++)
+        {
+            const char* newline = std::find(line, end, '\n');
+            const char* next = newline < end ? newline + 1 : end;
+            const char* start = line;
+            while (start < newline && (*start == ' ' || *start == '\t')) start++;
+            auto startsWith = [&](const char* directive) { return (size_t)(newline - start) >= strlen(directive) && strncmp(start, directive, strlen(directive)) == 0; };
+            if (startsWith("#include"))
+            {
+                const char* open = std::find(start, newline, '"');
+                const char* close = open < newline ? std::find(open + 1, newline, '"') : newline;
+                if (close == newline)
+                {
+                    std::cout << "ERROR::SHADER::BAD_INCLUDE: " << path << ":" << lineNumber << std::endl;
+                    success = false;
+                }
+                else
+                {
+                    success &= expand(directory + std::string(open + 1, close), defines, code, files, included, looseFiles, depth + 1);
+                    code.appendGenerated("#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n");
+                }
+                line = next;
+                continue;
+            }
+            code.append(line, next - line);
+            // the generated lines after it have to start on a line of their own
+            if (newline == end) code.appendGenerated("\n");
+            if (depth == 0 && startsWith("#version"))
+            {
+                std::string lines;
+                for (const std::string& define : defines) lines += "#define " + define + "\n";
+                lines += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+                code.appendGenerated(lines);
+            }
+            line = next;
+        }
+        return success;
+    }
+
+    void printFiles()
+    {
+        std::cout << "source string numbers:";
+        for (size_t i = 0; i < files.size(); i++) std::cout << " " << i << " = " << files[i];
+        std::cout << std::endl;
+    }
+
+    // straight from the program binary cache when it has these sources for this driver, compiled otherwise
+    bool build(const ShaderSource& vertexCode, const ShaderSource& fragmentCode, unsigned int& program)
+    {
+        std::string cacheKey = programCache().key(vertexCode, fragmentCode);
+        program = programCache().load(cacheKey);
+        if (program) return true;
+
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, vertexCode.count(), vertexCode.strings.data(), vertexCode.lengths.data());
+        glCompileShader(vertex);
+        bool success = checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, fragmentCode.count(), fragmentCode.strings.data(), fragmentCode.lengths.data());
+        glCompileShader(fragment);
+        success &= checkCompileErrors(fragment, "FRAGMENT");
+        // shader Program
+        program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        programCache().prepare(program);
+        glLinkProgram(program);
+        success &= checkCompileErrors(program, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessary
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        if (success) programCache().store(cacheKey, program);
+        return success;
+    }
+
+    int queryLocation(const std::string& name) const
+    {
+        locationQueries++;
+        return glGetUniformLocation(ID, name.c_str());
+    }
+};
+
+// Variants of one vertex/fragment pair that differ only in their defines, e.g. { "SPECULAR_MAP", "POINT_LIGHTS" }.
+// each variant is compiled the first time it's asked for, so only the combinations actually drawn with get built
+// and every one of them is a specialized program without the branches for features it doesn't use
+class ShaderPermutations
+{
+public:
+    std::string vertexPath, fragmentPath;
+    std::map<std::string, std::unique_ptr<Shader>> variants;
+    // runs once for every new variant, e.g. to set its constant uniforms
+    std::function<void(Shader&)> onCreate;
+
+    ShaderPermutations(const char* vertexPath, const char* fragmentPath) : vertexPath(vertexPath), fragmentPath(fragmentPath)
+    {
+    }
+
+    // the order of the defines doesn't matter
+    Shader& get(std::vector<std::string> defines)
+    {
+        std::sort(defines.begin(), defines.end());
+        std::string key;
+        for (const std::string& define : defines) key += define + ";";
+        std::unique_ptr<Shader>& variant = variants[key];
+        if (!variant)
+        {
+            variant.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines));
+            if (onCreate) onCreate(*variant);
+        }
+        return *variant;
+    }
+};
+// A compute program, expanded by the same preprocessor and built through the same program cache as Shader. Not
+// watched for changes, ShaderWatcher only knows vertex/fragment pairs
+class ComputeShader
+{
+public:
+    unsigned int ID;
+    std::string path;
+    std::vector<std::string> files;
+    ComputeShader(const char* path, const std::vector<std::string>& defines = {}) : path(path)
+    {
+        ShaderSource code;
+        Shader::preprocess(path, defines, code, files);
+        std::string cacheKey = programCache().key(code, ShaderSource());
+        ID = programCache().load(cacheKey);
+        if (ID) return;
+
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, code.count(), code.strings.data(), code.lengths.data());
+        glCompileShader(compute);
+        bool success = Shader::checkCompileErrors(compute, "COMPUTE");
+        ID = glCreateProgram();
+        glAttachShader(ID, compute);
+        programCache().prepare(ID);
+        glLinkProgram(ID);
+        success &= Shader::checkCompileErrors(ID, "PROGRAM");
+        glDeleteShader(compute);
+        if (success) programCache().store(cacheKey, ID);
+    }
+
+    void use()
+    {
+        renderState().useProgram(ID);
+    }
+
+    // enough work groups of groupSize (the shader's local_size_x) to cover count invocations
+    void dispatch(unsigned int count, unsigned int groupSize)
+    {
+        if (count > 0) glDispatchCompute((count + groupSize - 1) / groupSize, 1, 1);
+    }
+
+    int getUniformLocation(const char* name) const
+    {
+        return glGetUniformLocation(ID, name);
+    }
+
+    void destroy()
+    {
+        renderState().deleteProgram(ID);
     }
 };
 #endif
@@ -0,0 +1,69 @@
+#pragma once
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+// One expanded shader stage as the list of strings glShaderSource takes. Text that comes from a file is a span of
+// that file's contents, pointing straight into the asset pack's mapping when the file is packed, so nothing but the
+// generated #define and #line lines (and loose files, which have to be read somewhere) is ever copied. Consecutive
+// spans of the same file are merged, a stage without includes is a handful of strings. Move only, the spans point
+// into owned
+class ShaderSource
+{
+public:
+    std::vector<const char*> strings;
+    std::vector<GLint> lengths;
+
+    ShaderSource() = default;
+    ShaderSource(ShaderSource&&) = default;
+    ShaderSource& operator=(ShaderSource&&) = default;
+    ShaderSource(const ShaderSource&) = delete;
+    ShaderSource& operator=(const ShaderSource&) = delete;
+
+    // text that outlives the source, i.e. the mapping
+    void append(const char* data, size_t length)
+    {
+        if (length == 0) return;
+        if (extendable && strings.back() + lengths.back() == data)
+        {
+            lengths.back() += (GLint)length;
+            return;
+        }
+        strings.push_back(data);
+        lengths.push_back((GLint)length);
+        extendable = true;
+    }
+
+    // text the source keeps itself, returns where it ended up so spans of it can be appended
+    const std::string& own(std::string text)
+    {
+        owned.emplace_back(new std::string(std::move(text)));
+        return *owned.back();
+    }
+
+    // a generated line, never merged with the file text around it
+    void appendGenerated(std::string text)
+    {
+        const std::string& line = own(std::move(text));
+        strings.push_back(line.data());
+        lengths.push_back((GLint)line.size());
+        extendable = false;
+    }
+
+    void clear()
+    {
+        strings.clear();
+        lengths.clear();
+        owned.clear();
+        extendable = false;
+    }
+
+    GLsizei count() const { return (GLsizei)strings.size(); }
+
+private:
+    // behind pointers so the strings never move, short ones would with the small string optimization
+    std::vector<std::unique_ptr<std::string>> owned;
+    bool extendable = false; // the last string is a span of file text that the next one may continue
+};
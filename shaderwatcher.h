@@ -0,0 +1,175 @@
+#pragma once
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#include "shader.h"
+
+// Watches the source files (includes too) of every shader handed to watch() and recompiles the ones that change
+// while the program runs. A background thread polls the files' modification times, reads and preprocesses the new
+// sources, so the GL thread only compiles and links in update(). A shader whose new source doesn't build keeps its
+// old program. Polling rather than inotify/ReadDirectoryChangesW keeps it the same on every platform, and a few stat
+// calls every interval cost nothing
+class ShaderWatcher
+{
+public:
+    unsigned int reloads = 0, failures = 0;
+    float lastReloadMs = 0.0f;
+    // runs for every shader that got a new program. its uniforms start out at the defaults again, so anything set
+    // once at creation has to be set again here
+    std::function<void(Shader&)> onReload;
+
+    ShaderWatcher(int intervalMs = 250) : intervalMs(intervalMs)
+    {
+        thread = std::thread([this] { pollLoop(); });
+    }
+
+    ~ShaderWatcher()
+    {
+        destroy();
+    }
+
+    // the shader has to outlive the watcher
+    void watch(Shader& shader)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Watched entry;
+        entry.shader = &shader;
+        entry.vertexPath = shader.vertexPath;
+        entry.fragmentPath = shader.fragmentPath;
+        entry.defines = shader.defines;
+        for (const std::string& file : shader.files) entry.files.push_back({ file, fileStamp(file) });
+        watched.push_back(entry);
+    }
+
+    // call once per frame on the GL thread. returns how many shaders got a new program
+    unsigned int update()
+    {
+        std::vector<Changed> changes;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            changes.swap(changed);
+        }
+        unsigned int swapped = 0;
+        for (Changed& change : changes)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            if (change.shader->reload(change.vertexCode, change.fragmentCode, change.files))
+            {
+                std::cout << "SHADER::RELOADED: " << change.shader->vertexPath << " + " << change.shader->fragmentPath << std::endl;
+                if (onReload) onReload(*change.shader);
+                reloads++;
+                swapped++;
+            }
+            else failures++;
+            lastReloadMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        }
+        return swapped;
+    }
+
+    void destroy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (thread.joinable()) thread.join();
+    }
+
+private:
+    struct Watched
+    {
+        Shader* shader = NULL;
+        std::string vertexPath, fragmentPath;
+        std::vector<std::string> defines;
+        std::vector<std::pair<std::string, long long>> files; // with their stamps
+    };
+
+    struct Changed
+    {
+        Shader* shader = NULL;
+        ShaderSource vertexCode, fragmentCode;
+        std::vector<std::string> files;
+    };
+
+    int intervalMs;
+    std::vector<Watched> watched;
+    std::vector<Changed> changed;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread;
+
+    // modification time and size, st_mtime only has whole seconds so a save within the same second as the last
+    // one usually still shows up as a different size
+    static long long fileStamp(const std::string& path)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) return 0;
+        return ((long long)info.st_mtime << 24) ^ (long long)info.st_size;
+    }
+
+    void pollLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, std::chrono::milliseconds(intervalMs), [this] { return stopping; }))
+        {
+            // the file work happens unlocked, the entries are only ever appended to so indices stay valid
+            size_t count = watched.size();
+            for (size_t i = 0; i < count; i++)
+            {
+                Watched entry = watched[i];
+                lock.unlock();
+                std::vector<std::pair<std::string, long long>> stamps;
+                bool modified = false;
+                for (const std::pair<std::string, long long>& file : entry.files)
+                {
+                    stamps.push_back({ file.first, fileStamp(file.first) });
+                    modified |= stamps.back().second != file.second;
+                }
+                if (!modified)
+                {
+                    lock.lock();
+                    continue;
+                }
+                // always the loose files, those are the ones being edited even when the shader was first loaded from
+                // the pack. editors often save by truncating and then writing, so the stamps are taken before the
+                // read and checked again after it: a file that moved in between was caught mid save and is read
+                // again. the includes may have changed too, a new one only has its stamp from after the first read,
+                // so it's bracketed from the second on. a source that doesn't preprocess is reported once and waits
+                // for the next save
+                Changed change;
+                change.shader = entry.shader;
+                bool expanded = false, settled = false;
+                for (int attempt = 0; attempt < 3 && !settled; attempt++)
+                {
+                    change.files.clear();
+                    expanded = Shader::preprocess(entry.vertexPath, entry.defines, change.vertexCode, change.files, true);
+                    expanded &= Shader::preprocess(entry.fragmentPath, entry.defines, change.fragmentCode, change.files, true);
+                    std::vector<std::pair<std::string, long long>> after;
+                    settled = true;
+                    for (const std::string& file : change.files)
+                    {
+                        after.push_back({ file, fileStamp(file) });
+                        settled &= std::find(stamps.begin(), stamps.end(), after.back()) != stamps.end();
+                    }
+                    stamps = after;
+                }
+                lock.lock();
+                // still moving, the old stamps stay so the next poll tries again
+                if (!settled) continue;
+                watched[i].files = stamps;
+                if (!expanded) continue;
+                changed.push_back(std::move(change));
+            }
+        }
+    }
+};
@@ -0,0 +1,100 @@
+#pragma once
+#include <cmath>
+
+#define SIMULATION_TICK_RATE 60 // ticks per second
+#define SIMULATION_MAX_TICKS 8 // per frame, past that a slow frame drops the time instead of catching up
+
+// everything the simulation moves, one tick's worth
+struct SimulationState
+{
+	float rotation = 45.0f; // degrees, the cubes' spin
+};
+
+// what the simulation reads from the UI and input, copied in once per frame so a tick never sees it change halfway
+struct SimulationInput
+{
+	bool spin = false;
+	float spinSpeed = 0.5f; // degrees per tick
+};
+
+// one tick: a pure function of the last state and the input, so it doesn't care which thread or frame runs it
+inline SimulationState simulate(const SimulationState& state, const SimulationInput& input)
+{
+	SimulationState next = state;
+	if (input.spin) next.rotation += input.spinSpeed;
+	return next;
+}
+
+inline SimulationState interpolate(const SimulationState& previous, const SimulationState& current, float alpha)
+{
+	SimulationState state;
+	state.rotation = previous.rotation + (current.rotation - previous.rotation) * alpha;
+	return state;
+}
+
+// Runs simulate() at a fixed rate however fast frames come. Frame time goes into an accumulator and is spent in
+// whole ticks, the remainder carries over to the next frame. The last two states are kept, the tick writes the
+// older one and then the two swap, and rendering draws between them by how far into the next tick the accumulator
+// is. That renders up to one tick behind, but motion stays smooth when the frame rate and the tick rate don't divide
+// evenly, and with a tick that only reads one buffer and writes the other it can move to its own thread later
+class FixedTimestep
+{
+public:
+	const double tickLength = 1.0 / SIMULATION_TICK_RATE;
+	unsigned int ticks = 0; // run by the last advance()
+	unsigned long long totalTicks = 0;
+	unsigned int droppedFrames = 0; // frames that hit SIMULATION_MAX_TICKS
+
+	// spends frameTime seconds on ticks and returns how many ran
+	unsigned int advance(double frameTime, const SimulationInput& input)
+	{
+		accumulator += frameTime;
+		ticks = 0;
+		while (accumulator >= tickLength)
+		{
+			if (ticks == SIMULATION_MAX_TICKS)
+			{
+				accumulator = std::fmod(accumulator, tickLength);
+				droppedFrames++;
+				break;
+			}
+			states[1 - current] = simulate(states[current], input);
+			current = 1 - current;
+			accumulator -= tickLength;
+			ticks++;
+		}
+		totalTicks += ticks;
+		wrapRotation();
+		return ticks;
+	}
+
+	// how far past the current state the frame is, in ticks, 0 to 1
+	float alpha() const
+	{
+		return (float)(accumulator / tickLength);
+	}
+
+	const SimulationState& previous() const { return states[1 - current]; }
+	const SimulationState& latest() const { return states[current]; }
+
+	// what to render this frame
+	SimulationState interpolated() const
+	{
+		return interpolate(previous(), latest(), alpha());
+	}
+
+private:
+	SimulationState states[2];
+	int current = 0;
+	double accumulator = 0.0;
+
+	// the angle keeps growing while it spins, both states move back together so the interpolation doesn't jump
+	void wrapRotation()
+	{
+		while (states[0].rotation >= 360.0f && states[1].rotation >= 360.0f)
+		{
+			states[0].rotation -= 360.0f;
+			states[1].rotation -= 360.0f;
+		}
+	}
+};
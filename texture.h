@@ -1,9 +1,21 @@
 #pragma once
+// dds.h includes stb_image.h for its declarations, so it has to come before the implementation is pulled in
+#include "dds.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <iostream>
 #include <glad/glad.h>
 #include <cstring>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include "threadpool.h"
+#include "mipmap.h"
+#include "renderstate.h"
 
 class Texture
 {
@@ -14,36 +26,301 @@ public:
     unsigned int activeTextureOffset;
     Texture(const char* imagePath, unsigned int activeTextureOffset)
     {
-        // automatically determine if the image needs an alpha channel for transparency i.e. .png
-        unsigned int colorChannel = GL_RGB;
-        if (strstr(imagePath, ".png") != NULL)
+        stbi_set_flip_vertically_on_load(true);
+        generate(activeTextureOffset);
+
+        // baked textures (see bakeTexture in dds.h) already carry their compressed mips
+        size_t pathLength = strlen(imagePath);
+        if (pathLength > 4 && strcmp(imagePath + pathLength - 4, ".dds") == 0)
         {
-            colorChannel = GL_RGBA;
+            DDSImage image;
+            if (loadDDS(imagePath, image)) uploadDDS(image, image.bytes());
+            width = image.width;
+            height = image.height;
+            nrChannels = 0;
+            return;
         }
 
+        AssetFile file(imagePath);
+        unsigned char* data = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &nrChannels, 0);
+        if (data)
+        {
+            // the layout is whatever the file decoded to, not what its extension suggests (a PNG can be plain RGB).
+            // rows of 1 and 3 byte pixels aren't 4 byte aligned
+            static const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+            GLenum format = formats[nrChannels - 1];
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            // stb_image's 1 and 2 channel images are grey and grey + alpha, sample them that way
+            if (nrChannels <= 2)
+            {
+                GLint swizzle[] = { GL_RED, GL_RED, GL_RED, nrChannels == 2 ? GL_GREEN : GL_ONE };
+                glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+            }
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        else std::cout << "Failed to load texture" << std::endl;
+        stbi_image_free(data);
+    }
+
+    // a texture object with no image yet, bound to its unit. filled in later, e.g. by TextureLoader
+    Texture(unsigned int activeTextureOffset)
+    {
+        width = height = nrChannels = 0;
+        generate(activeTextureOffset);
+    }
+
+    void SetSampler2D(unsigned int shaderID, const char* samplerVariableName)
+    {
+        glUniform1i(glGetUniformLocation(shaderID, samplerVariableName), activeTextureOffset);
+    }
+
+private:
+    void generate(unsigned int activeTextureOffset)
+    {
         this->activeTextureOffset = activeTextureOffset;
-        stbi_set_flip_vertically_on_load(true);
         glGenTextures(1, &ID);
-        glActiveTexture(GL_TEXTURE0 + activeTextureOffset);
-        glBindTexture(GL_TEXTURE_2D, ID);
+        renderState().bindTexture(activeTextureOffset, ID);
         // set the texture wrapping/filtering options (on the currently bound texture object)
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+};
 
-        unsigned char* data = stbi_load(imagePath, &width, &height, &nrChannels, 0);
-        if (data)
+// Decodes images on the thread pool instead of the render thread. load() hands back a texture holding a 1x1 grey
+// placeholder straight away; update() then copies finished decodes into a persistently mapped staging buffer and
+// uploads them from there, stopping once the frame's time budget is used up. The staging buffer is a ring, every
+// upload fences its range so the CPU only waits if it laps a copy the GPU hasn't read yet.
+class TextureLoader
+{
+public:
+    unsigned int uploaded = 0;
+
+    TextureLoader(ThreadPool& pool, size_t stagingSize = 32 * 1024 * 1024) : pool(pool), stagingSize(stagingSize)
+    {
+        stbi_set_flip_vertically_on_load(true);
+        glGenBuffers(1, &staging);
+        renderState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, staging);
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, stagingSize, NULL, flags);
+        stagingMemory = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, stagingSize, flags);
+        renderState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // srgb picks gamma correct mip filtering, right for anything painted as a colour image
+    Texture load(const char* imagePath, unsigned int activeTextureOffset, bool srgb = true)
+    {
+        Texture texture(activeTextureOffset);
+        unsigned char grey[] = { 128, 128, 128 };
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        decoding++;
+        std::string path = imagePath;
+        unsigned int textureID = texture.ID;
+        pool.enqueue([this, path, textureID, activeTextureOffset, srgb]
         {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, colorChannel, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
+            Decoded image;
+            image.texture = textureID;
+            image.unit = activeTextureOffset;
+            if (path.size() > 4 && path.compare(path.size() - 4, 4, ".dds") == 0) loadDDS(path.c_str(), image.compressed);
+            else
+            {
+                // always RGBA so the mip generator has one layout to deal with, and its work stays on this thread
+                AssetFile file(path);
+                image.data = stbi_load_from_memory(file.data(), (int)file.size(), &image.width, &image.height, &image.channels, 4);
+                if (image.data) image.mips = generateMipChain(image.data, image.width, image.height, MIP_KAISER, srgb);
+                else std::cout << "Failed to load texture: " << path << std::endl;
+            }
+            {
+                std::lock_guard<std::mutex> lock(readyMutex);
+                ready.push_back(image);
+            }
+            decoding--;
+        });
+        return texture;
+    }
+
+    // call once per frame on the GL thread. always uploads at least one finished image, then keeps going while
+    // less than budgetMs has passed
+    void update(float budgetMs)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<Decoded> images;
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            images.swap(ready);
+        }
+        size_t i = 0;
+        for (; i < images.size(); i++)
+        {
+            if (i > 0 && std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count() > budgetMs) break;
+            upload(images[i]);
+        }
+
+        // whatever didn't fit goes back to the front of the queue for next frame
+        if (i < images.size())
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            ready.insert(ready.begin(), images.begin() + i, images.end());
         }
-        else std::cout << "Failed to load texture" << std::endl;
-        stbi_image_free(data);
     }
 
-    void SetSampler2D(unsigned int shaderID, const char* samplerVariableName)
+    // images still being decoded or waiting for upload
+    unsigned int pending()
     {
-        glUniform1i(glGetUniformLocation(shaderID, samplerVariableName), activeTextureOffset);
+        std::lock_guard<std::mutex> lock(readyMutex);
+        return (unsigned int)ready.size() + decoding.load();
+    }
+
+    // blocks until every requested image is uploaded, for when the first frame has to be complete
+    void finish()
+    {
+        while (pending() > 0)
+        {
+            update(1e30f);
+            std::this_thread::yield();
+        }
+    }
+
+    void destroy()
+    {
+        while (decoding.load() > 0) std::this_thread::yield();
+        for (Decoded& image : ready) stbi_image_free(image.data);
+        ready.clear();
+        for (InFlight& region : inFlight) glDeleteSync(region.fence);
+        inFlight.clear();
+        renderState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, staging);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        renderState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &staging);
+    }
+
+private:
+    struct Decoded
+    {
+        unsigned int texture = 0, unit = 0;
+        int width = 0, height = 0, channels = 0;
+        unsigned char* data = NULL;
+        std::vector<std::vector<unsigned char>> mips; // levels 1 and down, RGBA8
+        DDSImage compressed; // used instead of data for .dds files
+    };
+
+    struct InFlight
+    {
+        size_t offset, size;
+        GLsync fence;
+    };
+
+    ThreadPool& pool;
+    unsigned int staging;
+    unsigned char* stagingMemory;
+    size_t stagingSize;
+    size_t head = 0;
+    std::vector<InFlight> inFlight; // oldest first
+    std::vector<Decoded> ready;
+    std::mutex readyMutex;
+    std::atomic<unsigned int> decoding{ 0 };
+
+    void upload(Decoded& image)
+    {
+        if (image.compressed.levelCount() > 0)
+        {
+            uploadCompressed(image);
+            return;
+        }
+        if (!image.data) return;
+
+        // level 0 and the mips made on the worker go up together, no glGenerateMipmap
+        std::vector<const unsigned char*> levels(1, image.data);
+        for (const std::vector<unsigned char>& mip : image.mips) levels.push_back(mip.data());
+        size_t size = 0;
+        for (size_t level = 0; level < levels.size(); level++)
+            size += (size_t)std::max(1, image.width >> level) * std::max(1, image.height >> level) * 4;
+
+        renderState().bindTexture(image.unit, image.texture);
+        size_t offset = 0;
+        bool staged = size <= stagingSize;
+        if (staged)
+        {
+            offset = allocate(size);
+            renderState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, staging);
+        }
+        for (size_t level = 0; level < levels.size(); level++)
+        {
+            int width = std::max(1, image.width >> level), height = std::max(1, image.height >> level);
+            size_t levelSize = (size_t)width * height * 4;
+            const void* source = levels[level];
+            if (staged)
+            {
+                memcpy(stagingMemory + offset, levels[level], levelSize);
+                source = (void*)offset;
+                offset += levelSize;
+            }
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, source);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+        if (staged)
+        {
+            renderState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            inFlight.push_back({ offset - size, size, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+        }
+        renderState().activeTexture(0);
+        stbi_image_free(image.data);
+        image.data = NULL;
+        image.mips.clear();
+        uploaded++;
+    }
+
+    // the mips are already in the file, so this is just a copy into the ring and one call per level
+    void uploadCompressed(Decoded& image)
+    {
+        const DDSImage& dds = image.compressed;
+        renderState().bindTexture(image.unit, image.texture);
+        size_t size = dds.byteSize();
+        if (size <= stagingSize)
+        {
+            // for a packed file this is the only copy its levels ever get, straight from the mapping into the ring
+            size_t offset = allocate(size);
+            memcpy(stagingMemory + offset, dds.bytes(), size);
+            renderState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, staging);
+            uploadDDS(dds, (void*)offset);
+            renderState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            inFlight.push_back({ offset, size, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+        }
+        else uploadDDS(dds, dds.bytes());
+        renderState().activeTexture(0);
+        image.compressed = DDSImage();
+        uploaded++;
+    }
+
+    // next size bytes of the ring, waiting out any earlier upload the GPU may still be reading from them
+    size_t allocate(size_t size)
+    {
+        if (head + size > stagingSize) head = 0;
+        size_t offset = head;
+        head += size;
+        for (;;)
+        {
+            bool overlaps = false;
+            for (const InFlight& region : inFlight)
+                if (region.offset < offset + size && offset < region.offset + region.size) overlaps = true;
+            if (!overlaps) break;
+            glClientWaitSync(inFlight.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            glDeleteSync(inFlight.front().fence);
+            inFlight.erase(inFlight.begin());
+        }
+
+        // fences that already passed are dropped so the list stays short
+        while (!inFlight.empty() && glClientWaitSync(inFlight.front().fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+        {
+            glDeleteSync(inFlight.front().fence);
+            inFlight.erase(inFlight.begin());
+        }
+        return offset;
     }
 };
\ No newline at end of file
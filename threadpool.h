@@ -0,0 +1,107 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+
+// A fixed set of worker threads pulling tasks off one queue. The workers are started once so per-frame jobs
+// (light clustering and friends) don't pay for thread creation every frame.
+class ThreadPool
+{
+public:
+	ThreadPool(unsigned int threadCount = 0)
+	{
+		if (threadCount == 0) threadCount = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1;
+		for (unsigned int i = 0; i < threadCount; i++)
+			workers.emplace_back([this] { workerLoop(); });
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		queueCondition.notify_all();
+		for (std::thread& worker : workers) worker.join();
+	}
+
+	unsigned int size() const { return (unsigned int)workers.size(); }
+
+	void enqueue(std::function<void()> task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			tasks.push(std::move(task));
+		}
+		queueCondition.notify_one();
+	}
+
+	// runs fn(i) for every i in [0, count) and returns once all of them are done. the calling thread works
+	// through the indices too, so this still makes progress while the workers are stuck on longer tasks
+	void parallelFor(unsigned int count, const std::function<void(unsigned int)>& fn)
+	{
+		if (count == 0) return;
+		struct Job
+		{
+			std::atomic<unsigned int> next{ 0 };
+			std::atomic<unsigned int> done{ 0 };
+			unsigned int count = 0;
+			const std::function<void(unsigned int)>* fn = nullptr;
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+		std::shared_ptr<Job> job = std::make_shared<Job>();
+		job->count = count;
+		job->fn = &fn;
+
+		// helpers that only get scheduled after every index is claimed find nothing to do and return without
+		// touching fn, which is why the job is shared and fn is only read after claiming an index
+		auto work = [job]
+		{
+			unsigned int i;
+			while ((i = job->next.fetch_add(1)) < job->count)
+			{
+				(*job->fn)(i);
+				if (job->done.fetch_add(1) + 1 == job->count)
+				{
+					std::lock_guard<std::mutex> lock(job->mutex);
+					job->finished.notify_all();
+				}
+			}
+		};
+		unsigned int helpers = count - 1 < size() ? count - 1 : size();
+		for (unsigned int i = 0; i < helpers; i++) enqueue(work);
+		work();
+
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->finished.wait(lock, [&job] { return job->done.load() == job->count; });
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	bool stopping = false;
+
+	void workerLoop()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueCondition.wait(lock, [this] { return stopping || !tasks.empty(); });
+				if (stopping && tasks.empty()) return;
+				task = std::move(tasks.front());
+				tasks.pop();
+			}
+			task();
+		}
+	}
+};
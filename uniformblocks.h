@@ -0,0 +1,97 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// CPU mirrors of the std140 uniform blocks declared in the shaders. std140 aligns a vec3 to 16 bytes but lets a
+// following float fill the last 4, so members are ordered to pack that way; anything else is explicit padding.
+// Keep these in sync with the GLSL declarations.
+
+#define FRAME_BLOCK_BINDING 0
+#define LIGHT_BLOCK_BINDING 1
+
+// std430 shader storage blocks used by the clustered light lookup (see cluster.h)
+#define POINT_LIGHT_STORAGE_BINDING 2
+#define CLUSTER_STORAGE_BINDING 3
+#define CLUSTER_INDEX_STORAGE_BINDING 4
+// per draw data of a multi-draw indirect batch, indexed by gl_DrawID (see multidraw.h)
+#define DRAW_DATA_STORAGE_BINDING 5
+// GPU culling's objects and their transforms in, compacted indirect commands out, and the surviving count and object
+// indices (see gpuculling.h)
+#define CULL_OBJECT_STORAGE_BINDING 6
+#define CULL_COMMAND_STORAGE_BINDING 7
+#define CULL_RESULT_STORAGE_BINDING 8
+#define CULL_TRANSFORM_STORAGE_BINDING 9
+
+// layout (std140, binding = 0) uniform FrameData
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 viewPos;
+	float zNear;
+	glm::vec2 screenSize;
+	float zFar;
+	float padding;
+};
+
+struct DirLightData
+{
+	glm::vec3 direction;
+	float padding0;
+	glm::vec3 ambient;
+	float padding1;
+	glm::vec3 diffuse;
+	float padding2;
+	glm::vec3 specular;
+	float padding3;
+};
+
+struct PointLightData
+{
+	glm::vec3 position;
+	float constant;
+	glm::vec3 ambient;
+	float linear;
+	glm::vec3 diffuse;
+	float quadratic;
+	glm::vec3 specular;
+	float radius; // distance at which the attenuation drops below 1/256, used to bin the light into clusters
+};
+
+// layout (std140, binding = 1) uniform LightData
+struct LightUniforms
+{
+	DirLightData dirLight;
+};
+
+// layout (std430, binding = 2) buffer PointLightData is an unsized array of PointLightData
+
+// one entry of the std430 DrawDataBlock in lightingShader.vert. a std430 mat3 still pads every column to a vec4
+struct DrawData
+{
+	glm::mat4 model;
+	glm::vec4 normalMatrix[3];
+};
+
+// one entry of the std430 ObjectBlock in cullObjects.comp: the arena range of its mesh, which stays put between frames
+struct CullObject
+{
+	unsigned int indexCount, firstIndex;
+	int baseVertex;
+	unsigned int padding;
+};
+
+// one entry of the std430 TransformBlock in cullObjects.comp, the part of an object that moves: its model matrix and
+// world space bounds
+struct CullTransform
+{
+	glm::mat4 model;
+	glm::vec4 center;
+	glm::vec4 extent;
+};
+
+static_assert(sizeof(FrameUniforms) == 160, "FrameUniforms must match the std140 FrameData block");
+static_assert(sizeof(PointLightData) == 64, "PointLightData must match the std430 PointLight struct");
+static_assert(sizeof(LightUniforms) == 64, "LightUniforms must match the std140 LightData block");
+static_assert(sizeof(DrawData) == 112, "DrawData must match the std430 DrawData struct");
+static_assert(sizeof(CullObject) == 16, "CullObject must match the std430 CullObject struct");
+static_assert(sizeof(CullTransform) == 96, "CullTransform must match the std430 CullTransform struct");